@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Microbenchmark of the voxel_math.h kernels and of skinning pose
+// evaluation against the scalar code they replaced. Build with
+// -DVOXEL_BUILD_BENCHMARKS=ON (or `make bench`), add -DVOXEL_ENABLE_AVX2=ON
+// (`make bench AVX2=1`) for the AVX2 paths.
+
+#include "gltf_loader.h"
+#include "voxel_math.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace {
+
+// Previous scalar implementations, kept verbatim as the baseline.
+void ScalarMat4Mul(const float* a, const float* b, float* out) {
+    float r[16];
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) {
+            r[col * 4 + row] = a[0 * 4 + row] * b[col * 4 + 0] +
+                               a[1 * 4 + row] * b[col * 4 + 1] +
+                               a[2 * 4 + row] * b[col * 4 + 2] +
+                               a[3 * 4 + row] * b[col * 4 + 3];
+        }
+    }
+    for (int i = 0; i < 16; ++i)
+        out[i] = r[i];
+}
+
+void ScalarTransformPoint(const float* m, const float* p, float* out) {
+    out[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+    out[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+    out[2] = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+}
+
+void ScalarComposeTRS(const float* t, const float* q_in, const float* s, float* out) {
+    float q[4];
+    voxel::math::QuatNormalize(q_in, q);
+    const float x = q[0], y = q[1], z = q[2], w = q[3];
+    float tm[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, t[0], t[1], t[2], 1};
+    float rm[16] = {1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0,
+                    2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0,
+                    2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0,
+                    0, 0, 0, 1};
+    float sm[16] = {s[0], 0, 0, 0, 0, s[1], 0, 0, 0, 0, s[2], 0, 0, 0, 0, 1};
+    float rs[16];
+    ScalarMat4Mul(rm, sm, rs);
+    ScalarMat4Mul(tm, rs, out);
+}
+
+// Float keyframes of one node, as the pose evaluation held them before the
+// keyframe cursors and track compression.
+struct FloatNodeTracks {
+    std::vector<float> times;
+    std::vector<float> translation; // 3 per key
+    std::vector<float> rotation;    // 4 per key
+    std::vector<float> scale;       // 3 per key
+};
+
+// Previous keyframe sampling: a linear scan from the first key on every call.
+void ScalarSampleTrack(const std::vector<float>& times, const std::vector<float>& values, int components, float t,
+                       float* out) {
+    const size_t count = times.size();
+    if (count == 1 || t <= times.front()) {
+        std::memcpy(out, &values[0], sizeof(float) * components);
+        return;
+    }
+    if (t >= times.back()) {
+        std::memcpy(out, &values[(count - 1) * components], sizeof(float) * components);
+        return;
+    }
+    size_t k = 0;
+    while (k + 1 < count && !(t >= times[k] && t <= times[k + 1]))
+        ++k;
+    const float a = (times[k + 1] > times[k]) ? ((t - times[k]) / (times[k + 1] - times[k])) : 0.0f;
+    if (components == 4) {
+        voxel::math::QuatNlerp(&values[k * 4], &values[(k + 1) * 4], a, out);
+        return;
+    }
+    for (int c = 0; c < components; ++c)
+        out[c] = values[k * components + c] + (values[(k + 1) * components + c] - values[k * components + c]) * a;
+}
+
+// Previous pose evaluation: linear-scan sampling and recursive parent
+// resolution, then global * inverse_bind per joint.
+void ScalarEvaluatePose(const GltfSkeleton& skeleton, const std::vector<FloatNodeTracks>& tracks, float time,
+                        std::vector<float>* local, std::vector<float>* global, float* out_palette) {
+    const size_t node_count = skeleton.parents.size();
+    local->resize(node_count * 16u);
+    global->resize(node_count * 16u);
+    for (size_t ni = 0; ni < node_count; ++ni) {
+        float t[3];
+        float r[4];
+        float s[3];
+        ScalarSampleTrack(tracks[ni].times, tracks[ni].translation, 3, time, t);
+        ScalarSampleTrack(tracks[ni].times, tracks[ni].rotation, 4, time, r);
+        ScalarSampleTrack(tracks[ni].times, tracks[ni].scale, 3, time, s);
+        voxel::math::ComposeTRS(t, r, s, &(*local)[ni * 16u]);
+    }
+    std::vector<unsigned char> ready(node_count, 0u);
+    std::function<void(size_t)> compute_global = [&](size_t ni) {
+        if (ready[ni])
+            return;
+        const int p = skeleton.parents[ni];
+        if (p >= 0) {
+            compute_global(static_cast<size_t>(p));
+            voxel::math::Mat4Mul(&(*global)[p * 16u], &(*local)[ni * 16u], &(*global)[ni * 16u]);
+        } else {
+            std::memcpy(&(*global)[ni * 16u], &(*local)[ni * 16u], sizeof(float) * 16);
+        }
+        ready[ni] = 1u;
+    };
+    for (size_t ni = 0; ni < node_count; ++ni)
+        compute_global(ni);
+    for (size_t ji = 0; ji < skeleton.joints.size(); ++ji)
+        voxel::math::Mat4Mul(&(*global)[skeleton.joints[ji] * 16u], &skeleton.inverse_bind[ji * 16u], out_palette + ji * 16u);
+}
+
+float RandomFloat() {
+    return (float)std::rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+void FillRandom(std::vector<float>* v) {
+    for (size_t i = 0; i < v->size(); ++i)
+        (*v)[i] = RandomFloat();
+}
+
+double g_sink = 0.0;
+
+void Consume(const std::vector<float>& v) {
+    for (size_t i = 0; i < v.size(); i += 7)
+        g_sink += v[i];
+}
+
+template <typename Fn>
+double NanosecondsPerOp(size_t ops, int reps, Fn fn) {
+    fn(); // warm up
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r)
+        fn();
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return ns / ((double)ops * (double)reps);
+}
+
+void Report(const char* name, double scalar_ns, double kernel_ns) {
+    std::printf("%-34s %10.2f ns %10.2f ns %6.2fx\n", name, scalar_ns, kernel_ns, scalar_ns / kernel_ns);
+}
+
+// Dense mocap-like clip: joint_count joints in a spine with limb chains,
+// every node keyed at fps for `duration` seconds on all three channels
+// (scale constant, as exported by most mocap tools).
+void MakeDenseClip(size_t joint_count, float fps, float duration, GltfSkeleton* skeleton,
+                   std::vector<FloatNodeTracks>* float_tracks) {
+    const size_t key_count = static_cast<size_t>(duration * fps) + 1u;
+    skeleton->parents.resize(joint_count);
+    skeleton->node_order.resize(joint_count);
+    for (size_t i = 0; i < joint_count; ++i) {
+        // Nodes 0-5 form the spine, the rest chains of five hanging off it.
+        skeleton->parents[i] = (i == 0) ? -1 : (i < 6 ? (int)i - 1 : ((i - 6) % 5 == 0 ? (int)((i - 6) / 5 % 6) : (int)i - 1));
+        skeleton->node_order[i] = (int)i;
+        skeleton->joints.push_back((int)i);
+    }
+    skeleton->rest_translation.assign(joint_count * 3u, 0.0f);
+    skeleton->rest_rotation.assign(joint_count * 4u, 0.0f);
+    skeleton->rest_scale.assign(joint_count * 3u, 1.0f);
+    skeleton->rest_matrix.assign(joint_count * 16u, 0.0f);
+    skeleton->has_matrix.assign(joint_count, 0u);
+    skeleton->inverse_bind.assign(joint_count * 16u, 0.0f);
+    for (size_t i = 0; i < joint_count; ++i) {
+        skeleton->rest_rotation[i * 4u + 3u] = 1.0f;
+        for (int d = 0; d < 4; ++d)
+            skeleton->inverse_bind[i * 16u + d * 5] = 1.0f;
+    }
+    skeleton->clips.resize(1);
+    GltfSkeletonClip& clip = skeleton->clips[0];
+    clip.duration = duration;
+    clip.tracks.resize(joint_count);
+    float_tracks->resize(joint_count);
+    for (size_t i = 0; i < joint_count; ++i) {
+        FloatNodeTracks& ft = (*float_tracks)[i];
+        const float phase = RandomFloat() * 3.0f;
+        for (size_t k = 0; k < key_count; ++k) {
+            const float t = (float)k / fps;
+            ft.times.push_back(t);
+            ft.translation.push_back(i == 0 ? 0.8f * t : 0.0f);
+            ft.translation.push_back(i == 0 ? 1.0f + 0.05f * std::sin(6.0f * t) : 0.25f);
+            ft.translation.push_back(0.02f * std::sin(2.0f * t + phase));
+            const float angle = 0.4f * std::sin(3.0f * t + phase);
+            const float axis = 0.57735f * std::sin(angle);
+            const float q[4] = {axis, axis, axis, std::cos(angle)};
+            ft.rotation.insert(ft.rotation.end(), q, q + 4);
+            for (int c = 0; c < 3; ++c)
+                ft.scale.push_back(1.0f);
+        }
+        CompressGltfAnimationTrack(ft.times.data(), ft.translation.data(), key_count, 3, &clip.tracks[i].translation);
+        CompressGltfAnimationTrack(ft.times.data(), ft.rotation.data(), key_count, 4, &clip.tracks[i].rotation);
+        CompressGltfAnimationTrack(ft.times.data(), ft.scale.data(), key_count, 3, &clip.tracks[i].scale);
+    }
+}
+
+} // namespace
+
+int main() {
+    const size_t kMatrices = 4096;  // e.g. block models or a large joint palette
+    const size_t kPoints = 65536;   // vertices of a skinned mesh being tri-sorted
+    const int kReps = 200;
+
+    std::vector<float> a(kMatrices * 16), b(kMatrices * 16), out(kMatrices * 16);
+    std::vector<float> points(kPoints * 3), out_points(kPoints * 3);
+    std::vector<float> trs(kMatrices * 10);
+    FillRandom(&a);
+    FillRandom(&b);
+    FillRandom(&points);
+    FillRandom(&trs);
+
+    std::printf("voxel_math_bench (%s)\n",
+#if VOXEL_MATH_AVX2
+                "AVX2+FMA"
+#elif VOXEL_MATH_SSE2
+                "SSE2"
+#else
+                "scalar"
+#endif
+    );
+    std::printf("%-34s %13s %13s %7s\n", "kernel", "scalar", "voxel_math", "speedup");
+
+    double scalar_ns = NanosecondsPerOp(kMatrices, kReps, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i)
+            ScalarMat4Mul(&a[i * 16], &b[i * 16], &out[i * 16]);
+    });
+    Consume(out);
+    double kernel_ns = NanosecondsPerOp(kMatrices, kReps, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i)
+            voxel::math::Mat4Mul(&a[i * 16], &b[i * 16], &out[i * 16]);
+    });
+    Consume(out);
+    Report("mat4 * mat4", scalar_ns, kernel_ns);
+
+    // Skin palette: global * inverse_bind as a 4-vector batch per joint.
+    kernel_ns = NanosecondsPerOp(kMatrices, kReps, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i)
+            voxel::math::Mat4MulVec4Batch(&a[i * 16], &b[i * 16], &out[i * 16], 4);
+    });
+    Consume(out);
+    Report("mat4 * mat4 (vec4 batch of 4)", scalar_ns, kernel_ns);
+
+    scalar_ns = NanosecondsPerOp(kPoints, kReps, [&]() {
+        for (size_t i = 0; i < kPoints; ++i)
+            ScalarTransformPoint(&a[0], &points[i * 3], &out_points[i * 3]);
+    });
+    Consume(out_points);
+    kernel_ns = NanosecondsPerOp(kPoints, kReps, [&]() {
+        voxel::math::Mat4TransformPoints(&a[0], points.data(), out_points.data(), kPoints);
+    });
+    Consume(out_points);
+    Report("mat4 * point3", scalar_ns, kernel_ns);
+
+    scalar_ns = NanosecondsPerOp(kMatrices, kReps, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i)
+            ScalarComposeTRS(&trs[i * 10], &trs[i * 10 + 3], &trs[i * 10 + 7], &out[i * 16]);
+    });
+    Consume(out);
+    kernel_ns = NanosecondsPerOp(kMatrices, kReps, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i)
+            voxel::math::ComposeTRS(&trs[i * 10], &trs[i * 10 + 3], &trs[i * 10 + 7], &out[i * 16]);
+    });
+    Consume(out);
+    Report("compose TRS", scalar_ns, kernel_ns);
+
+    // Pose evaluation on a dense clip (65 joints, 120 FPS keys, 30 s), sampled
+    // at a 60 Hz display rate in order (keyframe cursors) and at shuffled
+    // times (binary search). Per pose.
+    {
+        const size_t kJoints = 65;
+        const float kClipSeconds = 30.0f;
+        const size_t kPoses = 1800;
+        const int kPoseReps = 3;
+        GltfSkeleton skeleton;
+        std::vector<FloatNodeTracks> float_tracks;
+        MakeDenseClip(kJoints, 120.0f, kClipSeconds, &skeleton, &float_tracks);
+        std::vector<float> in_order(kPoses), shuffled(kPoses);
+        for (size_t i = 0; i < kPoses; ++i)
+            in_order[i] = shuffled[i] = kClipSeconds * (float)i / (float)kPoses;
+        for (size_t i = kPoses - 1; i > 0; --i)
+            std::swap(shuffled[i], shuffled[(size_t)std::rand() % (i + 1)]);
+        std::vector<float> palette(kJoints * 16), local, global;
+        GltfPoseScratch scratch;
+
+        const std::vector<float>* orders[2] = {&in_order, &shuffled};
+        const char* names[2] = {"pose, dense clip (in order)", "pose, dense clip (random times)"};
+        for (int o = 0; o < 2; ++o) {
+            const std::vector<float>& times = *orders[o];
+            scalar_ns = NanosecondsPerOp(kPoses, kPoseReps, [&]() {
+                for (size_t i = 0; i < kPoses; ++i)
+                    ScalarEvaluatePose(skeleton, float_tracks, times[i], &local, &global, palette.data());
+            });
+            Consume(palette);
+            kernel_ns = NanosecondsPerOp(kPoses, kPoseReps, [&]() {
+                for (size_t i = 0; i < kPoses; ++i)
+                    EvaluateGltfPose(skeleton, 0, times[i], &scratch, palette.data());
+            });
+            Consume(palette);
+            Report(names[o], scalar_ns, kernel_ns);
+        }
+
+        // 30 FPS bake of the whole clip, on the calling thread vs. split
+        // across a worker pool (one thread per core). Per baked frame.
+        voxel::VoxelWorkerPool pool;
+        pool.init();
+        GltfSkinningFrames serial_frames;
+        GltfSkinningFrames pool_frames;
+        const size_t bake_frames = (size_t)(kClipSeconds * 30.0f) + 1u;
+        scalar_ns = NanosecondsPerOp(bake_frames, kPoseReps, [&]() {
+            BakeGltfSkinningFrames(skeleton, &serial_frames, nullptr, nullptr);
+        });
+        kernel_ns = NanosecondsPerOp(bake_frames, kPoseReps, [&]() {
+            BakeGltfSkinningFrames(skeleton, &pool_frames, nullptr, &pool);
+        });
+        Consume(pool_frames.palettes);
+        char bake_name[64];
+        std::snprintf(bake_name, sizeof(bake_name), "bake frame (pool, %u threads)", pool.threadCount());
+        Report(bake_name, scalar_ns, kernel_ns);
+        if (serial_frames.palettes != pool_frames.palettes)
+            std::printf("bake mismatch between serial and pool palettes\n");
+        pool.shutdown();
+    }
+
+    std::printf("(checksum %g)\n", g_sink);
+    return 0;
+}
@@ -19,6 +19,57 @@ struct GltfAnimationLibrary {
     std::vector<GltfAnimationClip> clips;
 };
 
+// Keyframes of one animated node property, compressed to 16 bits per
+// value: translation and scale keys are 3 unorm16 within
+// [value_min, value_min + value_extent] per axis, rotation keys are xyzw
+// quaternions as 4 snorm16. Keys that repeat both neighbours are dropped
+// (linear interpolation gives the same values), so a constant track keeps
+// a single key.
+struct GltfAnimationTrack {
+    std::vector<float> times;
+    std::vector<uint16_t> values;
+    float value_min[3] = {0.0f, 0.0f, 0.0f};
+    float value_extent[3] = {0.0f, 0.0f, 0.0f};
+};
+
+struct GltfNodeTracks {
+    GltfAnimationTrack translation;
+    GltfAnimationTrack rotation;
+    GltfAnimationTrack scale;
+};
+
+struct GltfSkeletonClip {
+    std::string name;
+    float duration = 0.0f;
+    std::vector<GltfNodeTracks> tracks; // one per node; empty tracks keep the rest pose
+};
+
+// Node hierarchy, skin and keyframe tracks of a skinned model, kept so poses
+// can be evaluated at any time instead of from pre-baked frames.
+struct GltfSkeleton {
+    std::vector<int> parents;               // per node, -1 for roots
+    std::vector<int> node_order;            // every node once, parents first
+    std::vector<float> rest_translation;    // 3 per node
+    std::vector<float> rest_rotation;       // 4 per node
+    std::vector<float> rest_scale;          // 3 per node
+    std::vector<float> rest_matrix;         // 16 per node
+    std::vector<unsigned char> has_matrix;  // node given as a matrix, never animated
+    std::vector<int> joints;                // skin joint -> node
+    std::vector<float> inverse_bind;        // 16 per joint
+    std::vector<GltfSkeletonClip> clips;
+
+    uint32_t jointCount() const { return static_cast<uint32_t>(joints.size()); }
+};
+
+// Reusable buffers for EvaluateGltfPose; one per thread. Sampling times
+// that increase from call to call (baking, time-sorted poses) lets the
+// keyframe cursors skip the search.
+struct GltfPoseScratch {
+    std::vector<float> local;       // 16 per node
+    std::vector<float> global;      // 16 per node
+    std::vector<uint32_t> cursors;  // last key pair per node track (t, r, s)
+};
+
 struct GltfSkinningFrames {
     uint32_t joint_count = 0;
     uint32_t frame_count = 0;
@@ -26,11 +77,69 @@ struct GltfSkinningFrames {
     std::vector<float> palettes; // frame_count * joint_count * 16
 };
 
+// Baked palettes with each joint matrix packed by voxel::math::PackSkinJoint
+// into 16 bytes instead of 64: rotation quaternion (snorm16), translation
+// (unorm16 within translation_bounds) and uniform scale (half). CPU-side
+// storage only: UnpackGltfSkinningFrame expands a frame to the mat4s the
+// skin palette buffer holds.
+struct GltfPackedSkinningFrames {
+    uint32_t joint_count = 0;
+    uint32_t frame_count = 0;
+    float duration = 0.0f;
+    float translation_bounds[6] = {}; // min xyz, extent xyz over all frames
+    std::vector<uint32_t> joints;     // frame_count * joint_count * 4
+};
+
+// Compresses `count` keys of `components` floats (3, or 4 for rotation
+// quaternions) into out_track.
+void CompressGltfAnimationTrack(const float* times,
+                                const float* values,
+                                size_t count,
+                                int components,
+                                GltfAnimationTrack* out_track);
+
 bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* error);
 bool LoadGltfAnimationLibrary(const std::string& path,
                               GltfAnimationLibrary* out_library,
                               std::string* error);
+// Loads the first skin of model_path and every animation of animation_path
+// (or of the model itself), remapped onto the model's nodes by name.
+bool LoadGltfSkeleton(const std::string& model_path,
+                      const std::string& animation_path,
+                      GltfSkeleton* out_skeleton,
+                      std::string* error);
+// Writes jointCount() column-major joint matrices for `clip` sampled at
+// `time` seconds (clamped to the clip) to out_palette.
+void EvaluateGltfPose(const GltfSkeleton& skeleton,
+                      size_t clip,
+                      float time,
+                      GltfPoseScratch* scratch,
+                      float* out_palette);
+// Bakes the first clip at 30 FPS. With a worker pool (e.g.
+// VoxelRenderer::workerPool()) the frame range is split across its threads,
+// without one the bake runs on the calling thread; the palettes are
+// identical either way.
+bool LoadGltfSkinningFrames(const std::string& model_path,
+                            const std::string& animation_path,
+                            GltfSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers = nullptr);
+// Same bake, packed frame by frame so the float palettes are never held.
+// Fails for skeletons whose joint matrices have shear or non-uniform scale;
+// bake those with the GltfSkinningFrames overload.
 bool LoadGltfSkinningFrames(const std::string& model_path,
                             const std::string& animation_path,
+                            GltfPackedSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers = nullptr);
+// The bakes above on an already loaded skeleton.
+bool BakeGltfSkinningFrames(const GltfSkeleton& skeleton,
                             GltfSkinningFrames* out_frames,
-                            std::string* error);
\ No newline at end of file
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers = nullptr);
+bool BakeGltfSkinningFrames(const GltfSkeleton& skeleton,
+                            GltfPackedSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers = nullptr);
+// Expands one packed frame into joint_count column-major mat4s.
+void UnpackGltfSkinningFrame(const GltfPackedSkinningFrames& frames, uint32_t frame, float* out_palette);
\ No newline at end of file
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_AABB_TREE_H
+#define VOXEL_AABB_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace voxel {
+
+struct VoxelAabb {
+    float min[3];
+    float max[3];
+};
+
+// Six clip planes (a*x + b*y + c*z + d >= 0 is inside) taken from a
+// column-major view-projection matrix with clip-space depth in [0, w].
+struct VoxelFrustum {
+    float planes[6][4];
+
+    static VoxelFrustum fromMatrix(const float m[16]);
+    // Sub-frustum covering only the NDC rectangle [min_x, max_x] x [min_y, max_y].
+    static VoxelFrustum fromMatrixRect(const float m[16], float min_x, float min_y, float max_x, float max_y);
+    bool intersects(const VoxelAabb& box) const;
+};
+
+// Dynamic AABB tree (incrementally balanced BVH). Leaves are inserted and
+// removed one at a time, so editing a block costs O(log n) instead of a
+// rebuild. Proxy ids stay valid until the proxy is removed.
+class VoxelAabbTree {
+public:
+    static const int kNullNode = -1;
+
+    VoxelAabbTree();
+
+    void clear();
+    int insert(const VoxelAabb& box, uint32_t user_data);
+    void remove(int proxy);
+    void update(int proxy, const VoxelAabb& box);
+    void setUserData(int proxy, uint32_t user_data);
+    uint32_t userData(int proxy) const;
+    size_t size() const;
+
+    // Appends the user data of every leaf whose box touches the frustum.
+    void queryFrustum(const VoxelFrustum& frustum, std::vector<uint32_t>* out) const;
+
+private:
+    struct Node {
+        VoxelAabb box;
+        int parent = kNullNode; // next free node while on the free list
+        int child[2] = {kNullNode, kNullNode};
+        int height = 0;
+        uint32_t user_data = 0;
+
+        bool isLeaf() const { return child[0] == kNullNode; }
+    };
+
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int node);
+    int balance(int node);
+
+    std::vector<Node> nodes_;
+    int root_;
+    int free_list_;
+    size_t leaf_count_;
+};
+
+} // namespace voxel
+
+#endif
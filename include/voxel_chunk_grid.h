@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_CHUNK_GRID_H
+#define VOXEL_CHUNK_GRID_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace voxel {
+
+struct ChunkKey {
+    int x;
+    int y;
+    int z;
+
+    bool operator<(const ChunkKey& other) const {
+        if (x != other.x)
+            return x < other.x;
+        if (y != other.y)
+            return y < other.y;
+        return z < other.z;
+    }
+};
+
+// Sparse grid of axis-aligned unit cubes, bucketed into fixed-size chunks.
+// Each chunk is meshed independently: faces shared with a solid neighbour
+// (also across chunk borders) are dropped and coplanar faces with the same
+// texture are merged into larger quads.
+class VoxelChunkGrid {
+public:
+    static const int kChunkSize = 16;
+
+    struct Section {
+        int tex_index = 0;
+        std::vector<float> positions; // xyz per vertex, world space
+        std::vector<float> normals;   // xyz per vertex
+        std::vector<float> uvs;       // uv per vertex, one unit per cell
+    };
+
+    VoxelChunkGrid();
+
+    void reset(float cell_size);
+    float cellSize() const;
+
+    // Maps a world-space block centre to a cell. The first mapped block fixes
+    // the grid phase; later blocks must be aligned to it.
+    bool cellForPosition(float x, float y, float z, int* out_x, int* out_y, int* out_z);
+
+    bool insertCell(int x, int y, int z, int tex_index);
+    bool removeCell(int x, int y, int z);
+    bool hasCell(int x, int y, int z) const;
+
+    const std::set<ChunkKey>& dirtyChunks() const;
+    void clearDirty();
+    bool hasChunk(const ChunkKey& key) const;
+    void chunkBounds(const ChunkKey& key, float out_min[3], float out_max[3]) const;
+    void buildChunkMesh(const ChunkKey& key, std::vector<Section>* out_sections) const;
+
+private:
+    struct Chunk {
+        std::vector<int> cells;
+        int solid_count = 0;
+    };
+
+    static int floorDiv(int value, int divisor);
+    static ChunkKey keyForCell(int x, int y, int z);
+    static int cellIndex(int lx, int ly, int lz);
+    int cellAt(int x, int y, int z) const;
+    void markDirty(int x, int y, int z);
+
+    float cell_size_;
+    float origin_[3];
+    bool has_origin_;
+    std::map<ChunkKey, Chunk> chunks_;
+    std::set<ChunkKey> dirty_;
+};
+
+} // namespace voxel
+
+#endif
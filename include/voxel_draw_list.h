@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_DRAW_LIST_H
+#define VOXEL_DRAW_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace voxel {
+
+// Per-frame list of draws ordered by a packed 64-bit key. The list remembers
+// the order of the previous frame: items are first laid out in that order,
+// and a list that is still nearly sorted (at most about one inversion per
+// item) is finished with an insertion sort instead of a full radix sort.
+class VoxelDrawList {
+public:
+    struct Item {
+        uint64_t key;
+        uint32_t id;
+    };
+
+    // Key helpers. Field widths: pipeline 4 bits, mesh 16 bits, texture
+    // 12 bits, depth 32 bits; larger values are clamped.
+    static uint64_t opaqueKey(uint32_t pipeline, uint32_t mesh, uint32_t texture, float dist2);
+    static uint64_t backToFrontKey(float dist2);
+
+    void clear();
+    void add(uint64_t key, uint32_t id);
+    void sort();
+
+    size_t size() const { return items_.size(); }
+    const Item& operator[](size_t i) const { return items_[i]; }
+
+private:
+    void radixSort();
+    bool insertionSort(size_t max_moves);
+
+    std::vector<Item> items_;
+    std::vector<Item> scratch_;
+    std::vector<uint32_t> prev_rank_; // indexed by id, rank in last sorted order
+    std::vector<uint32_t> prev_ids_;
+    std::vector<uint32_t> slots_;
+};
+
+} // namespace voxel
+
+#endif
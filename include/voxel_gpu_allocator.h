@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_GPU_ALLOCATOR_H
+#define VOXEL_GPU_ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+namespace voxel {
+
+// A sub-range of a pooled VkDeviceMemory block. Bind resources with
+// (memory, offset); never vkMapMemory the memory directly, host-visible
+// blocks are mapped once and `mapped` already points at `offset`.
+struct VoxelGpuAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    unsigned char* mapped = nullptr;
+    int pool = -1;
+    int block = -1;
+
+    bool valid() const { return memory != VK_NULL_HANDLE; }
+};
+
+struct VoxelGpuMemoryStats {
+    VkDeviceSize bytes_reserved = 0; // sum of all vkAllocateMemory sizes
+    VkDeviceSize bytes_in_use = 0;
+    uint32_t block_count = 0;        // live VkDeviceMemory objects
+    uint32_t allocation_count = 0;
+    VkDeviceSize largest_free_range = 0;
+    float fragmentation = 0.0f;      // 1 - largest free range / total free
+};
+
+// Pooled allocator: one pool per (memory type, linear/optimal) pair, each a
+// list of large blocks carved up by a first-fit free list that coalesces on
+// free. Linear (buffer) and optimal (image) resources never share a block,
+// so bufferImageGranularity does not apply. Requests larger than half a
+// block get a dedicated VkDeviceMemory.
+class VoxelGpuAllocator {
+public:
+    enum ResourceKind { kLinear = 0, kOptimal = 1 };
+
+    VoxelGpuAllocator();
+
+    void init(VkDevice device, VkPhysicalDevice physical_device);
+    void shutdown();
+
+    bool allocate(const VkMemoryRequirements& reqs, VkMemoryPropertyFlags properties, ResourceKind kind,
+                  VoxelGpuAllocation* out);
+    // Returns the range to its block and resets *allocation. No-op for
+    // invalid allocations.
+    void free(VoxelGpuAllocation* allocation);
+
+    VoxelGpuMemoryStats stats() const;
+
+private:
+    struct Range {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        VkDeviceSize used = 0;
+        unsigned char* mapped = nullptr;
+        uint32_t allocation_count = 0;
+        bool dedicated = false;
+        std::vector<Range> free_ranges; // sorted by offset, never adjacent
+    };
+    struct Pool {
+        uint32_t memory_type = 0;
+        ResourceKind kind = kLinear;
+        std::vector<Block> blocks; // empty slots have memory == VK_NULL_HANDLE
+    };
+
+    int findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    int findPool(uint32_t memory_type, ResourceKind kind);
+    int createBlock(Pool* pool, VkDeviceSize size, bool dedicated);
+    void destroyBlock(Block* block);
+    static bool allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* out_offset);
+    static void releaseToBlock(Block* block, VkDeviceSize offset, VkDeviceSize size);
+
+    VkDevice device_;
+    VkPhysicalDeviceMemoryProperties memory_properties_;
+    std::vector<Pool> pools_;
+};
+
+} // namespace voxel
+
+#endif
@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_MATH_H
+#define VOXEL_MATH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// The AVX2 paths are only compiled in when the build targets AVX2 (the
+// VOXEL_ENABLE_AVX2 CMake option or `make AVX2=1`); MSVC's /arch:AVX2 implies
+// FMA without defining __FMA__.
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define VOXEL_MATH_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOXEL_MATH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Small shared math kernels for the renderer and the animation baker.
+// Matrices are column-major float[16] (the layout of VoxelRenderer::Mat4 and
+// the shaders); quaternions are xyzw. The scalar fallbacks are written as
+// straight-line loops so they also vectorize on NEON targets.
+namespace voxel {
+namespace math {
+
+// out = a * b. out may alias a or b.
+inline void Mat4Mul(const float* a, const float* b, float* out) {
+#if VOXEL_MATH_SSE2
+    const __m128 a0 = _mm_loadu_ps(a + 0);
+    const __m128 a1 = _mm_loadu_ps(a + 4);
+    const __m128 a2 = _mm_loadu_ps(a + 8);
+    const __m128 a3 = _mm_loadu_ps(a + 12);
+    for (int col = 0; col < 4; ++col) {
+        const float* bc = b + col * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_storeu_ps(out + col * 4, r);
+    }
+#else
+    float r[16];
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) {
+            r[col * 4 + row] = a[0 * 4 + row] * b[col * 4 + 0] +
+                               a[1 * 4 + row] * b[col * 4 + 1] +
+                               a[2 * 4 + row] * b[col * 4 + 2] +
+                               a[3 * 4 + row] * b[col * 4 + 3];
+        }
+    }
+    for (int i = 0; i < 16; ++i)
+        out[i] = r[i];
+#endif
+}
+
+// out[i] = m * in[i] for `count` xyzw vectors. out may alias in (but not m).
+// With count == 4 this is m * b for a column-major matrix b.
+inline void Mat4MulVec4Batch(const float* m, const float* in, float* out, size_t count) {
+    size_t i = 0;
+#if VOXEL_MATH_AVX2
+    // Two vectors per iteration: each 256-bit lane pair holds one vec4.
+    const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 0));
+    const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 4));
+    const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 8));
+    const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 12));
+    for (; i + 2 <= count; i += 2) {
+        const __m256 v = _mm256_loadu_ps(in + i * 4);
+        __m256 r = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+        r = _mm256_fmadd_ps(c1, _mm256_permute_ps(v, 0x55), r);
+        r = _mm256_fmadd_ps(c2, _mm256_permute_ps(v, 0xAA), r);
+        r = _mm256_fmadd_ps(c3, _mm256_permute_ps(v, 0xFF), r);
+        _mm256_storeu_ps(out + i * 4, r);
+    }
+#endif
+#if VOXEL_MATH_SSE2
+    const __m128 s0 = _mm_loadu_ps(m + 0);
+    const __m128 s1 = _mm_loadu_ps(m + 4);
+    const __m128 s2 = _mm_loadu_ps(m + 8);
+    const __m128 s3 = _mm_loadu_ps(m + 12);
+    for (; i < count; ++i) {
+        const __m128 v = _mm_loadu_ps(in + i * 4);
+        __m128 r = _mm_mul_ps(s0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_add_ps(r, _mm_mul_ps(s1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_add_ps(r, _mm_mul_ps(s2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm_add_ps(r, _mm_mul_ps(s3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm_storeu_ps(out + i * 4, r);
+    }
+#else
+    // Local copy: out may alias in, so the compiler would otherwise reload m
+    // after every store.
+    float c[16];
+    std::memcpy(c, m, sizeof(c));
+    for (; i < count; ++i) {
+        const float x = in[i * 4 + 0];
+        const float y = in[i * 4 + 1];
+        const float z = in[i * 4 + 2];
+        const float w = in[i * 4 + 3];
+        for (int row = 0; row < 4; ++row)
+            out[i * 4 + row] = c[row] * x + c[4 + row] * y + c[8 + row] * z + c[12 + row] * w;
+    }
+#endif
+}
+
+// Transforms `count` xyz points (w = 1) by m. out may alias in.
+inline void Mat4TransformPoints(const float* m, const float* in, float* out, size_t count) {
+#if VOXEL_MATH_SSE2
+    const __m128 c0 = _mm_loadu_ps(m + 0);
+    const __m128 c1 = _mm_loadu_ps(m + 4);
+    const __m128 c2 = _mm_loadu_ps(m + 8);
+    const __m128 c3 = _mm_loadu_ps(m + 12);
+    for (size_t i = 0; i < count; ++i) {
+        const float* p = in + i * 3;
+        __m128 r = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(p[0])));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+        float* dst = out + i * 3;
+        _mm_storel_pi(reinterpret_cast<__m64*>(dst), r);
+        _mm_store_ss(dst + 2, _mm_movehl_ps(r, r));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        const float x = in[i * 3 + 0];
+        const float y = in[i * 3 + 1];
+        const float z = in[i * 3 + 2];
+        out[i * 3 + 0] = m[0] * x + m[4] * y + m[8] * z + m[12];
+        out[i * 3 + 1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+        out[i * 3 + 2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+    }
+#endif
+}
+
+inline void QuatNormalize(const float* q, float* out) {
+    const float len2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    if (len2 <= 1e-16f) {
+        out[0] = 0.0f;
+        out[1] = 0.0f;
+        out[2] = 0.0f;
+        out[3] = 1.0f;
+        return;
+    }
+    const float inv = 1.0f / std::sqrt(len2);
+    for (int i = 0; i < 4; ++i)
+        out[i] = q[i] * inv;
+}
+
+// Normalized lerp along the shorter arc.
+inline void QuatNlerp(const float* a, const float* b, float t, float* out) {
+    const float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    const float tb = (dot < 0.0f) ? -t : t;
+    float r[4];
+    for (int i = 0; i < 4; ++i)
+        r[i] = a[i] * (1.0f - t) + b[i] * tb;
+    QuatNormalize(r, out);
+}
+
+// out = T(t) * R(q) * S(s), written directly instead of via two Mat4Mul.
+// q does not need to be normalized.
+inline void ComposeTRS(const float* t, const float* q_in, const float* s, float* out) {
+    float q[4];
+    QuatNormalize(q_in, q);
+    const float x = q[0];
+    const float y = q[1];
+    const float z = q[2];
+    const float w = q[3];
+    out[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+    out[1] = (2.0f * (x * y + z * w)) * s[0];
+    out[2] = (2.0f * (x * z - y * w)) * s[0];
+    out[3] = 0.0f;
+    out[4] = (2.0f * (x * y - z * w)) * s[1];
+    out[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+    out[6] = (2.0f * (y * z + x * w)) * s[1];
+    out[7] = 0.0f;
+    out[8] = (2.0f * (x * z + y * w)) * s[2];
+    out[9] = (2.0f * (y * z - x * w)) * s[2];
+    out[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+    out[11] = 0.0f;
+    out[12] = t[0];
+    out[13] = t[1];
+    out[14] = t[2];
+    out[15] = 1.0f;
+}
+
+// Splits the upper 3x3 of a column-major matrix into a unit quaternion and
+// a uniform scale (the mean column length). Returns false if the matrix has
+// shear, non-uniform scale or a reflection; q and scale are then only the
+// closest rotation and uniform scale.
+inline bool DecomposeRotationScale(const float* m, float* q, float* scale) {
+    const float len0 = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    const float len1 = std::sqrt(m[4] * m[4] + m[5] * m[5] + m[6] * m[6]);
+    const float len2 = std::sqrt(m[8] * m[8] + m[9] * m[9] + m[10] * m[10]);
+    const float s = (len0 + len1 + len2) / 3.0f;
+    *scale = s;
+    if (s <= 1e-20f) {
+        q[0] = 0.0f;
+        q[1] = 0.0f;
+        q[2] = 0.0f;
+        q[3] = 1.0f;
+        return false;
+    }
+    const float inv = 1.0f / s;
+    const float r00 = m[0] * inv, r10 = m[1] * inv, r20 = m[2] * inv;
+    const float r01 = m[4] * inv, r11 = m[5] * inv, r21 = m[6] * inv;
+    const float r02 = m[8] * inv, r12 = m[9] * inv, r22 = m[10] * inv;
+    // Shepperd: pivot on the largest of w, x, y, z.
+    const float trace = r00 + r11 + r22;
+    float r[4];
+    if (trace > 0.0f) {
+        const float k = 2.0f * std::sqrt(1.0f + trace);
+        r[0] = (r21 - r12) / k;
+        r[1] = (r02 - r20) / k;
+        r[2] = (r10 - r01) / k;
+        r[3] = 0.25f * k;
+    } else if (r00 > r11 && r00 > r22) {
+        const float k = 2.0f * std::sqrt(std::max(1.0f + r00 - r11 - r22, 1e-20f));
+        r[0] = 0.25f * k;
+        r[1] = (r01 + r10) / k;
+        r[2] = (r02 + r20) / k;
+        r[3] = (r21 - r12) / k;
+    } else if (r11 > r22) {
+        const float k = 2.0f * std::sqrt(std::max(1.0f + r11 - r00 - r22, 1e-20f));
+        r[0] = (r01 + r10) / k;
+        r[1] = 0.25f * k;
+        r[2] = (r12 + r21) / k;
+        r[3] = (r02 - r20) / k;
+    } else {
+        const float k = 2.0f * std::sqrt(std::max(1.0f + r22 - r00 - r11, 1e-20f));
+        r[0] = (r02 + r20) / k;
+        r[1] = (r12 + r21) / k;
+        r[2] = 0.25f * k;
+        r[3] = (r10 - r01) / k;
+    }
+    QuatNormalize(r, q);
+
+    const float tolerance = 1e-3f;
+    const float d01 = (r00 * r01 + r10 * r11 + r20 * r21);
+    const float d02 = (r00 * r02 + r10 * r12 + r20 * r22);
+    const float d12 = (r01 * r02 + r11 * r12 + r21 * r22);
+    const float det = r00 * (r11 * r22 - r21 * r12) - r01 * (r10 * r22 - r20 * r12) + r02 * (r10 * r21 - r20 * r11);
+    return std::fabs(len0 * inv - 1.0f) <= tolerance && std::fabs(len1 * inv - 1.0f) <= tolerance &&
+           std::fabs(len2 * inv - 1.0f) <= tolerance && std::fabs(d01) <= tolerance &&
+           std::fabs(d02) <= tolerance && std::fabs(d12) <= tolerance && det > 0.0f;
+}
+
+// IEEE 754 binary16 conversions, rounding to nearest even. Values beyond
+// the half range become infinity; NaN stays NaN.
+inline uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t abs_bits = bits & 0x7fffffffu;
+    if (abs_bits >= 0x7f800000u)
+        return (uint16_t)(sign | 0x7c00u | ((abs_bits > 0x7f800000u) ? 0x200u : 0u));
+    if (abs_bits >= 0x477ff000u) // rounds past 65504
+        return (uint16_t)(sign | 0x7c00u);
+    if (abs_bits < 0x38800000u) {
+        // Subnormal half (or zero): shift the implicit-one mantissa into place.
+        if (abs_bits < 0x33000000u)
+            return (uint16_t)sign;
+        const uint32_t exponent = abs_bits >> 23;
+        const uint32_t mantissa = (abs_bits & 0x7fffffu) | 0x800000u;
+        const uint32_t shift = 126u - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1u);
+        const uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            half += 1u;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((abs_bits - 0x38000000u) >> 13);
+    const uint32_t rest = abs_bits & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half += 1u;
+    return (uint16_t)(sign | half);
+}
+
+inline float HalfToFloat(uint16_t half) {
+    const uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+    if (exponent == 0x1fu) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        uint32_t e = 113u;
+        while (!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            e -= 1u;
+        }
+        bits = sign | (e << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline uint32_t PackSnorm16(float value) {
+    const float c = (value < -1.0f) ? -1.0f : ((value > 1.0f) ? 1.0f : value);
+    return (uint32_t)(uint16_t)(int16_t)std::floor(c * 32767.0f + 0.5f);
+}
+
+inline uint32_t PackUnorm16(float value) {
+    const float c = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+    return (uint32_t)std::floor(c * 65535.0f + 0.5f);
+}
+
+// A skinning matrix (rotation, uniform scale, translation) in 16 bytes,
+// unpackable with the GLSL unpackSnorm2x16 / unpackUnorm2x16 /
+// unpackHalf2x16 built-ins:
+//   out[0] = snorm16 q.x | snorm16 q.y << 16
+//   out[1] = snorm16 q.z | snorm16 q.w << 16
+//   out[2] = unorm16 u.x | unorm16 u.y << 16
+//   out[3] = unorm16 u.z | half scale << 16
+// where the translation is t_min + u * t_extent. t_min / t_extent are the
+// bounds of the translations the matrices can take (e.g. over a clip), so
+// the 16-bit steps are relative to that range. Returns false when m can
+// not be represented exactly (see DecomposeRotationScale); the closest
+// rotation and uniform scale are packed anyway.
+inline bool PackSkinJoint(const float* m, const float* t_min, const float* t_extent, uint32_t* out) {
+    float q[4];
+    float scale;
+    const bool exact = DecomposeRotationScale(m, q, &scale);
+    uint32_t u[3];
+    for (int axis = 0; axis < 3; ++axis)
+        u[axis] = PackUnorm16((t_extent[axis] > 0.0f) ? (m[12 + axis] - t_min[axis]) / t_extent[axis] : 0.0f);
+    out[0] = PackSnorm16(q[0]) | (PackSnorm16(q[1]) << 16);
+    out[1] = PackSnorm16(q[2]) | (PackSnorm16(q[3]) << 16);
+    out[2] = u[0] | (u[1] << 16);
+    out[3] = u[2] | ((uint32_t)FloatToHalf(scale) << 16);
+    return exact;
+}
+
+// Inverse of PackSkinJoint: writes the column-major mat4.
+inline void UnpackSkinJoint(const uint32_t* in, const float* t_min, const float* t_extent, float* out) {
+    float q[4];
+    for (int i = 0; i < 4; ++i) {
+        const int16_t v = (int16_t)(uint16_t)(in[i / 2] >> ((i & 1) * 16));
+        const float f = (float)v / 32767.0f;
+        q[i] = (f < -1.0f) ? -1.0f : f;
+    }
+    float t[3];
+    t[0] = t_min[0] + t_extent[0] * ((float)(in[2] & 0xffffu) / 65535.0f);
+    t[1] = t_min[1] + t_extent[1] * ((float)(in[2] >> 16) / 65535.0f);
+    t[2] = t_min[2] + t_extent[2] * ((float)(in[3] & 0xffffu) / 65535.0f);
+    const float scale = HalfToFloat((uint16_t)(in[3] >> 16));
+    const float s[3] = {scale, scale, scale};
+    ComposeTRS(t, q, s, out);
+}
+
+// Component types of integer vertex data (glTF accessors, including
+// KHR_mesh_quantization).
+enum IntComponentType { kComponentInt8, kComponentUint8, kComponentInt16, kComponentUint16 };
+
+inline size_t IntComponentSize(IntComponentType type) {
+    return (type == kComponentInt8 || type == kComponentUint8) ? 1 : 2;
+}
+
+#if VOXEL_MATH_SSE2
+// Widens eight 16-bit lanes to int32, converts, scales and clamps them, and
+// stores the low four floats to lo_dst and the high four to hi_dst.
+inline void IntWordsToFloat8(__m128i words, bool is_signed, __m128 scale4, __m128 min4, float* lo_dst, float* hi_dst) {
+    __m128i lo;
+    __m128i hi;
+    if (is_signed) {
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+    } else {
+        const __m128i zero = _mm_setzero_si128();
+        lo = _mm_unpacklo_epi16(words, zero);
+        hi = _mm_unpackhi_epi16(words, zero);
+    }
+    _mm_storeu_ps(lo_dst, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale4), min4));
+    _mm_storeu_ps(hi_dst, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale4), min4));
+}
+#endif
+
+// Reads `count` rows of `components` (1-4) integer components, the rows
+// `stride` bytes apart, and writes row i as floats to out + i * out_stride.
+// Each value becomes max(value * scale, min_value): pass 1/255, 1/65535,
+// 1/127 or 1/32767 with min_value -1 for normalized data, and 1 with
+// -FLT_MAX for plain integers. `available` is the number of readable bytes
+// at src; the SIMD path only issues loads that stay inside it.
+inline void IntRowsToFloat(const unsigned char* src,
+                           size_t stride,
+                           size_t available,
+                           size_t count,
+                           int components,
+                           IntComponentType type,
+                           float scale,
+                           float min_value,
+                           float* out,
+                           size_t out_stride) {
+    size_t i = 0;
+#if VOXEL_MATH_SSE2
+    const size_t component_size = IntComponentSize(type);
+    const __m128 scale4 = _mm_set1_ps(scale);
+    const __m128 min4 = _mm_set1_ps(min_value);
+    const __m128i zero = _mm_setzero_si128();
+    // Tightly packed rows are one stream of values: each 16-byte load covers
+    // several rows (16 8-bit or 8 16-bit values) and yields 4 or 2 vectors of
+    // four floats. The output must be packed the same way, or hold exactly
+    // one row per vector (4 components). A row cut off by the last load is
+    // redone by the paths below.
+    const size_t values_per_load = 16 / component_size;
+    const size_t value_count = count * (size_t)components;
+    if (stride == component_size * (size_t)components && (out_stride == (size_t)components || components == 4)) {
+        const bool is_signed = type == kComponentInt8 || type == kComponentInt16;
+        const size_t dst_step = (out_stride == (size_t)components) ? 4 : out_stride;
+        const size_t load_count = std::min(value_count / values_per_load, available / 16);
+        float* dst = out;
+        for (size_t l = 0; l < load_count; ++l, dst += dst_step * (values_per_load / 4)) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + l * 16));
+            __m128i lo = bytes;
+            __m128i hi = bytes;
+            if (component_size == 1) {
+                if (type == kComponentUint8) {
+                    lo = _mm_unpacklo_epi8(bytes, zero);
+                    hi = _mm_unpackhi_epi8(bytes, zero);
+                } else {
+                    lo = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+                    hi = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+                }
+            }
+            IntWordsToFloat8(lo, is_signed, scale4, min4, dst, dst + dst_step);
+            if (component_size == 1)
+                IntWordsToFloat8(hi, is_signed, scale4, min4, dst + 2 * dst_step, dst + 3 * dst_step);
+        }
+        i = load_count * values_per_load / (size_t)components;
+    }
+    // Remaining rows one per iteration: a 4 (8-bit) or 8 (16-bit) byte load
+    // is widened to four int32 lanes, converted and scaled; only
+    // `components` lanes are stored so out_stride may be smaller than 4.
+    const size_t load_bytes = component_size * 4;
+    for (; i < count && i * stride + load_bytes <= available; ++i) {
+        const unsigned char* row = src + i * stride;
+        __m128i wide;
+        if (component_size == 1) {
+            int32_t packed;
+            std::memcpy(&packed, row, sizeof(packed));
+            const __m128i bytes = _mm_cvtsi32_si128(packed);
+            if (type == kComponentUint8) {
+                wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+            } else {
+                const __m128i words = _mm_unpacklo_epi8(bytes, bytes);
+                wide = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 24);
+            }
+        } else {
+            const __m128i words = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row));
+            if (type == kComponentUint16)
+                wide = _mm_unpacklo_epi16(words, zero);
+            else
+                wide = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+        }
+        const __m128 value = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(wide), scale4), min4);
+        float* dst = out + i * out_stride;
+        if (components == 4) {
+            _mm_storeu_ps(dst, value);
+        } else if (components == 1) {
+            _mm_store_ss(dst, value);
+        } else {
+            _mm_storel_pi(reinterpret_cast<__m64*>(dst), value);
+            if (components == 3)
+                _mm_store_ss(dst + 2, _mm_movehl_ps(value, value));
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        const unsigned char* row = src + i * stride;
+        float* dst = out + i * out_stride;
+        for (int c = 0; c < components; ++c) {
+            float value;
+            if (type == kComponentInt8) {
+                value = (float)(int8_t)row[c];
+            } else if (type == kComponentUint8) {
+                value = (float)row[c];
+            } else if (type == kComponentInt16) {
+                int16_t v;
+                std::memcpy(&v, row + 2 * c, sizeof(v));
+                value = (float)v;
+            } else {
+                uint16_t v;
+                std::memcpy(&v, row + 2 * c, sizeof(v));
+                value = (float)v;
+            }
+            value *= scale;
+            dst[c] = (value < min_value) ? min_value : value;
+        }
+    }
+}
+
+} // namespace math
+} // namespace voxel
+
+#endif
@@ -24,6 +24,16 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <map>
+#include <memory>
+#include "voxel_aabb_tree.h"
+#include "voxel_chunk_grid.h"
+#include "voxel_draw_list.h"
+#include "voxel_gpu_allocator.h"
+#include "voxel_texture_loader.h"
+#include "voxel_worker_pool.h"
+
+struct GltfSkeleton;
 
 namespace voxel {
 
@@ -40,8 +50,29 @@ public:
         std::string key;
         int mesh_index = -1;
         int scale_percent = 100;
+        // Start time (seconds) of the block's animation, so crowds sharing a
+        // skinned mesh don't all play in lockstep.
+        float animation_offset = 0.0f;
+    };
+
+    enum AnimationLoopMode { kAnimationLoop = 0, kAnimationClamp = 1 };
+    // Playback state of a skinned block. render() advances every state once
+    // per frame before any draws are recorded.
+    struct AnimationState {
+        int clip = 0;       // animation of the mesh's glTF file; out of range plays clip 0
+        float time = 0.0f;  // seconds into the clip
+        float speed = 1.0f; // playback rate, negative plays backwards
+        AnimationLoopMode loop_mode = kAnimationLoop;
     };
 
+    // Stable id for a block across addBlocks/removeBlocks. Dense block indices
+    // (as used by setSelection and pickRect) shift when blocks are removed.
+    // The low 32 bits name a slot, the high 32 bits its generation; a slot is
+    // never reused once its generation is exhausted, so a stale handle can't
+    // resolve to a later block.
+    typedef uint64_t BlockHandle;
+    static const BlockHandle kInvalidBlockHandle = 0;
+
     struct MeshData {
         std::vector<float> positions;
         std::vector<float> normals;
@@ -49,12 +80,21 @@ public:
         std::vector<float> colors;
         std::vector<uint32_t> joints; // 4 indices per vertex
         std::vector<float> weights;   // 4 weights per vertex
+        std::vector<uint32_t> indices; // triangle list; empty draws the vertices in order
         bool is_skinned = false;
         std::string source_model_path;
         std::string source_animation_path;
     };
 
     VoxelRenderer();
+    // Depth format to use for the main pass depth attachment when passing
+    // main_pass_has_depth = true to init(); VK_FORMAT_UNDEFINED if none fits.
+    static VkFormat findDepthFormat(VkPhysicalDevice physical_device);
+    // frames_in_flight is the number of frames the caller records ahead of
+    // the GPU (command buffers with an unsignaled fence). Per-frame buffers
+    // are ringed over that many slots and released resources are destroyed
+    // that many render() calls later, so it must not be lower than the real
+    // count.
     bool init(VkDevice device,
               VkPhysicalDevice physical_device,
               VkQueue queue,
@@ -65,15 +105,38 @@ public:
               const char* pick_vertex_shader_path,
               const char* pick_fragment_shader_path,
               const char* ground_texture_path,
-              const std::vector<std::string>& block_texture_paths);
+              const std::vector<std::string>& block_texture_paths,
+              bool main_pass_has_depth = false,
+              const char* instanced_vertex_shader_path = nullptr,
+              uint32_t frames_in_flight = 3);
     void shutdown();
     void render(VkCommandBuffer cmd, int width, int height);
     void setCamera(float x, float y, float z, float yaw_radians, float pitch_radians);
     void setBlocks(const std::vector<Block>& blocks, float block_size);
     void setSelection(const std::vector<unsigned char>& selected_flags);
+    // One handle per input block; kInvalidBlockHandle for blocks that could
+    // not be added (handle space exhausted).
+    std::vector<BlockHandle> addBlocks(const std::vector<Block>& blocks);
+    void removeBlocks(const std::vector<BlockHandle>& handles);
+    bool updateBlock(BlockHandle handle, const Block& block);
+    bool setBlockSelected(BlockHandle handle, bool selected);
+    bool setBlockAnimation(BlockHandle handle, const AnimationState& state);
+    bool blockAnimation(BlockHandle handle, AnimationState* out_state) const;
+    // Skinned draws of the same mesh and clip share a pose when their
+    // animation times are equal. A quantum > 0 (seconds) rounds the times to
+    // multiples of it first, so nearby times share too at the cost of
+    // stepped playback; 0, the default, keeps every pose exact.
+    void setSkinPoseTimeQuantum(float seconds);
+    int blockIndex(BlockHandle handle) const;
+    BlockHandle blockHandle(size_t index) const;
     void setBlockMeshes(const std::vector<MeshData>& meshes);
     void resizePickResources(uint32_t width, uint32_t height);
     bool pickRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, std::vector<unsigned char>* out_flags);
+    // Device memory held by the renderer's pooled allocator.
+    VoxelGpuMemoryStats memoryStats() const;
+    // Worker threads started by init() for texture decoding and pose
+    // evaluation; pass it to LoadGltfSkinningFrames to bake on them too.
+    VoxelWorkerPool& workerPool() { return worker_pool_; }
 
 private:
     struct Vertex {
@@ -84,25 +147,98 @@ private:
         uint32_t joints[4];
         float weights[4];
     };
+    // Compact block mesh layouts. The vertex input formats expand them to the
+    // same shader inputs as Vertex, so all pipelines share one vertex shader.
+    enum VertexLayout {
+        kVertexLayoutFull = 0,
+        kVertexLayoutStatic = 1,  // StaticVertex; joints/weights from a constant binding
+        kVertexLayoutSkinned = 2, // SkinnedVertex
+    };
+    struct StaticVertex {
+        uint16_t pos[4];  // half floats, w = 1
+        int8_t normal[4]; // snorm8
+        uint16_t uv[2];   // half floats
+        uint8_t color[4]; // unorm8
+    };
+    struct SkinnedVertex {
+        float pos[3];
+        int8_t normal[4];
+        uint16_t uv[2];
+        uint8_t color[4];
+        uint8_t joints[4];
+        uint8_t weights[4]; // unorm8, sums to 255
+    };
     struct BlockTexture {
         VkImage image = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VoxelGpuAllocation memory;
         VkImageView view = VK_NULL_HANDLE;
     };
     struct MeshBuffer {
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VoxelGpuAllocation memory;
         uint32_t vertex_count = 0;
-        std::vector<Vertex> cpu_vertices;
+        VertexLayout layout = kVertexLayoutFull;
+        VkBuffer index_buffer = VK_NULL_HANDLE;
+        VoxelGpuAllocation index_memory;
+        uint32_t index_count = 0;
+        std::vector<float> cpu_positions;
+        std::vector<uint32_t> cpu_indices;
+        float bounds_min[3] = {-0.5f, -0.5f, -0.5f}; // bind pose, mesh space
+        float bounds_max[3] = {0.5f, 0.5f, 0.5f};
         float ground_offset_y = 0.0f;
         bool is_skinned = false;
         std::string source_model_path;
         std::string source_animation_path;
-        float animation_time = 0.0f;
-        float animation_duration = 0.0f;
+        std::shared_ptr<const GltfSkeleton> skeleton; // tracks sampled per frame in render()
         uint32_t joint_count = 0;
-        uint32_t frame_count = 0;
-        std::vector<float> skin_palette; // mat4 array, column-major
+    };
+    struct ChunkSection {
+        int tex_index = 0;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VoxelGpuAllocation memory;
+        uint32_t vertex_count = 0;
+    };
+    struct ChunkBuffer {
+        VoxelAabb bounds;
+        std::vector<ChunkSection> sections;
+    };
+    // Per-instance input of the instanced vertex shader: locations 6-9 hold
+    // the model matrix columns, location 10 the tint (rgb) and texture index.
+    struct InstanceData {
+        float model[16];
+        float tint[4];
+    };
+    struct InstanceBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VoxelGpuAllocation memory;
+        InstanceData* mapped = nullptr;
+        size_t capacity = 0;
+    };
+    struct HandleSlot {
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        bool live = false;
+    };
+    struct RetiredBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VoxelGpuAllocation memory;
+        uint64_t retire_frame = 0;
+    };
+    struct SkinRequest {
+        uint32_t mesh = 0;
+        uint32_t clip = 0;
+        float time = 0.0f; // animation time, rounded to skin_pose_time_quantum_ if set
+        uint32_t draw = 0; // index into block_draws_
+    };
+    struct SkinPose {
+        uint32_t mesh = 0;
+        uint32_t clip = 0;
+        float time = 0.0f;
+        uint32_t joint_base = 0; // first joint in the frame's palette region
+    };
+    struct RetiredDescriptorSet {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        uint64_t retire_frame = 0;
     };
 
 public:
@@ -112,12 +248,44 @@ public:
 
 private:
     bool createShaderModule(const char* path, VkShaderModule* out_module);
-    bool createVertexBuffer(const Vertex* vertices, size_t count, VkBuffer* out_buffer, VkDeviceMemory* out_memory);
-    uint32_t findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
-    bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* out_buffer, VkDeviceMemory* out_memory);
-    bool createTextureImage(const char* path, VkImage* out_image, VkDeviceMemory* out_memory, VkImageView* out_view);
-    void transitionImageLayout(VkCommandBuffer cmd, VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout);
-    void copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+    bool createVertexBuffer(const void* vertices, VkDeviceSize size, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory);
+    bool createStaticVertexBuffer(const void* vertices, VkDeviceSize size, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory);
+    bool createIndexBuffer(const uint32_t* indices, size_t count, bool host_visible, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory);
+    void retireMeshBuffer(MeshBuffer* mesh);
+    bool reserveStaging(VkDeviceSize size, VkDeviceSize* out_offset);
+    bool stageBufferUpload(const void* data, VkDeviceSize size, VkBuffer dst_buffer);
+    bool flushUploads();
+    bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory);
+    bool allocateImageMemory(VkImage image, VoxelGpuAllocation* out_memory);
+    bool uploadTexture(const VoxelTextureData& texture, VkImage* out_image, VoxelGpuAllocation* out_memory, VkImageView* out_view);
+    void transitionImageLayout(VkCommandBuffer cmd, VkImage image, uint32_t base_level, uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout);
+    void copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize buffer_offset, VkImage image, uint32_t mip_level, uint32_t width, uint32_t height);
+    BlockHandle allocateBlockHandle(uint32_t index);
+    void releaseBlockHandle(BlockHandle handle);
+    bool appendBlockState(const Block& block);
+    void attachBlockState(size_t index);
+    void detachBlockState(size_t index);
+    void eraseBlock(size_t index);
+    void setSelectedFlag(size_t index, bool selected);
+    bool isChunkCandidate(size_t index) const;
+    void addBlockToChunks(size_t index);
+    void removeBlockFromChunks(size_t index);
+    void updateChunkBuffers();
+    void retireBuffer(VkBuffer buffer, const VoxelGpuAllocation& memory);
+    void retireDescriptorSet(VkDescriptorSet set);
+    void releaseRetiredBuffers(bool force);
+    void updateAnimations(float dt);
+    void evaluateSkinPoses(float* palette_region);
+    bool ensureSkinPaletteCapacity(uint32_t joint_count);
+    bool allocateDescriptorSet(VkDescriptorSet* out_set);
+    void bindDescriptorSet(VkCommandBuffer cmd, uint32_t frame_slot);
+
+    bool ensureInstanceCapacity(InstanceBuffer* instances, size_t count);
+    uint32_t textureSlot(int tex_index) const;
+    const MeshBuffer* blockMesh(const Block& block) const;
+    VkPipeline blockPipeline(const MeshBuffer* mesh) const;
+    Mat4 blockModelMatrix(const Block& block, const MeshBuffer* mesh) const;
+    VoxelAabb blockBounds(size_t index) const;
 
     Mat4 mat4Identity() const;
     Mat4 mat4Multiply(const Mat4& a, const Mat4& b) const;
@@ -132,28 +300,55 @@ private:
 
     VkDevice device_;
     VkPhysicalDevice physical_device_;
+    VoxelGpuAllocator gpu_allocator_;
+    VoxelWorkerPool worker_pool_;
     VkQueue queue_;
     uint32_t queue_family_;
     VkRenderPass render_pass_;
     VkPipelineLayout pipeline_layout_;
     VkPipeline pipeline_;
     VkPipeline pipeline_skinned_;
+    VkPipeline pipeline_instanced_;
+    VkPipeline pipeline_compact_;
+    VkPipeline pipeline_skinned_compact_;
     VkShaderModule vert_shader_;
+    VkShaderModule instanced_vert_shader_;
     VkShaderModule frag_shader_;
     VkDescriptorSetLayout descriptor_set_layout_;
     VkDescriptorPool descriptor_pool_;
     VkDescriptorSet descriptor_set_;
     VkSampler texture_sampler_;
+    // Skin palette ring: one region of skin_palette_capacity_ joints per
+    // frame in flight, selected with a dynamic offset. Vertex shader
+    // interface (set 0, binding 2): a dynamic storage buffer of column-major
+    // mat4s, one per joint. A skinned draw has push constant skin.y = 1 and
+    // skin.x = the palette index of its joint 0.
     VkBuffer skin_palette_buffer_;
-    VkDeviceMemory skin_palette_memory_;
+    VoxelGpuAllocation skin_palette_memory_;
+    uint32_t skin_palette_capacity_ = 0;
+    VkDeviceSize skin_palette_stride_ = 0;
+    VkDeviceSize skin_palette_align_ = 1;
+    std::vector<SkinRequest> skin_requests_;
+    std::vector<SkinPose> skin_poses_;
+    std::vector<uint32_t> skin_draw_base_; // palette joint base per block_draws_ entry
+    VkBuffer view_proj_buffer_;
+    VoxelGpuAllocation view_proj_memory_;
+    unsigned char* view_proj_mapped_;
+    VkDeviceSize view_proj_stride_;
+    std::vector<InstanceBuffer> instance_buffers_; // one per frame in flight
     VkImage ground_texture_image_;
-    VkDeviceMemory ground_texture_memory_;
+    VoxelGpuAllocation ground_texture_memory_;
     VkImageView ground_texture_view_;
-    std::vector<BlockTexture> block_textures_;
+    std::vector<BlockTexture> block_textures_; // one per distinct texture path
+    std::vector<uint32_t> texture_slots_;      // catalog tex_index -> binding 1 slot
+    uint32_t block_texture_count_ = 0;         // descriptors in binding 1
+    bool blit_mips_ = false;                   // RGBA8 mip chains built with vkCmdBlitImage
     VkBuffer ground_buffer_;
-    VkDeviceMemory ground_memory_;
+    VoxelGpuAllocation ground_memory_;
     VkBuffer cube_buffer_;
-    VkDeviceMemory cube_memory_;
+    VoxelGpuAllocation cube_memory_;
+    VkBuffer no_skin_buffer_; // joints/weights of kVertexLayoutStatic
+    VoxelGpuAllocation no_skin_memory_;
     uint32_t ground_vertex_count_;
     uint32_t cube_vertex_count_;
     std::vector<MeshBuffer> block_meshes_;
@@ -165,6 +360,25 @@ private:
     std::vector<Block> blocks_;
     float block_scale_;
     std::vector<unsigned char> selected_flags_;
+    std::vector<BlockHandle> block_handles_;
+    std::vector<HandleSlot> handle_slots_;
+    std::vector<uint32_t> free_handle_slots_;
+    VoxelAabbTree block_tree_;
+    std::vector<int> block_proxy_; // block_tree_ leaf per block
+    std::vector<Mat4> block_models_; // cached blockModelMatrix() per block
+    std::vector<AnimationState> block_animation_;
+    float skin_pose_time_quantum_ = 0.0f;
+    VoxelDrawList block_draws_;
+    VoxelDrawList instance_draws_;
+    bool main_pass_has_depth_ = false;
+    VoxelChunkGrid chunk_grid_;
+    std::vector<unsigned char> block_in_chunk_;
+    std::vector<int> block_cell_; // xyz cell per block routed into chunk_grid_
+    std::map<ChunkKey, ChunkBuffer> chunk_buffers_;
+    std::vector<RetiredBuffer> retired_buffers_;
+    std::vector<RetiredDescriptorSet> retired_descriptor_sets_;
+    uint64_t frame_index_ = 0;
+    uint32_t frames_in_flight_ = 3; // see init()
 
     VkRenderPass pick_render_pass_;
     VkPipelineLayout pick_pipeline_layout_;
@@ -172,16 +386,28 @@ private:
     VkShaderModule pick_vert_shader_;
     VkShaderModule pick_frag_shader_;
     VkImage pick_image_;
-    VkDeviceMemory pick_image_memory_;
+    VoxelGpuAllocation pick_image_memory_;
     VkImageView pick_image_view_;
     VkImage pick_depth_image_;
-    VkDeviceMemory pick_depth_memory_;
+    VoxelGpuAllocation pick_depth_memory_;
     VkImageView pick_depth_view_;
     VkFramebuffer pick_framebuffer_;
     VkExtent2D pick_extent_;
     VkCommandPool pick_command_pool_;
     VkCommandBuffer pick_command_buffer_;
     VkFence pick_fence_;
+
+    // Staging ring for DEVICE_LOCAL buffer and texture uploads. Copies are
+    // recorded into upload_command_buffer_ and submitted together by
+    // flushUploads(); the ring restarts at offset 0 after each flush.
+    VkBuffer staging_buffer_;
+    VoxelGpuAllocation staging_memory_;
+    unsigned char* staging_mapped_;
+    VkDeviceSize staging_capacity_;
+    VkDeviceSize staging_head_;
+    VkCommandBuffer upload_command_buffer_;
+    VkFence upload_fence_;
+    bool upload_recording_;
 };
 
 } // namespace voxel
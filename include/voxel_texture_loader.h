@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_TEXTURE_LOADER_H
+#define VOXEL_TEXTURE_LOADER_H
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace voxel {
+
+// CPU-side texture ready for upload: one or more mip levels packed back to
+// back in `pixels`, level 0 first.
+struct VoxelTextureData {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    std::vector<size_t> level_offsets; // byte offset of each mip level
+    std::vector<unsigned char> pixels;
+
+    uint32_t levelCount() const { return (uint32_t)level_offsets.size(); }
+    bool isCompressed() const { return format != VK_FORMAT_R8G8B8A8_UNORM; }
+};
+
+// Number of levels in a full mip chain down to 1x1.
+uint32_t MipLevelCount(uint32_t width, uint32_t height);
+
+// Loads a .dds file holding BC1 (DXT1), BC3 (DXT5) or BC7 data, including
+// the mip levels stored in the file, or any format stb_image reads as RGBA8
+// level 0. Returns false (and leaves *out empty) if the file can't be used.
+bool LoadVoxelTexture(const std::string& path, VoxelTextureData* out);
+
+// Appends a box-filtered mip chain to a single-level RGBA8 texture.
+void GenerateMipChainRgba8(VoxelTextureData* texture);
+
+} // namespace voxel
+
+#endif
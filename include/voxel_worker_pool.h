@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOXEL_WORKER_POOL_H
+#define VOXEL_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace voxel {
+
+// Persistent worker threads for data-parallel jobs: texture decoding, skin
+// pose evaluation and skinning bakes. The threads are started once by
+// init() and sleep between runs, so a run costs a wake-up instead of a
+// thread spawn and join.
+class VoxelWorkerPool {
+public:
+    // job(index, worker): worker is in [0, threadCount()) and stays fixed
+    // for the duration of the job, so it can select per-thread scratch.
+    typedef std::function<void(size_t, unsigned int)> Job;
+
+    VoxelWorkerPool();
+    ~VoxelWorkerPool();
+
+    // thread_count counts the calling thread; 0 = one per hardware thread.
+    // Not thread-safe against run().
+    void init(unsigned int thread_count = 0);
+    void shutdown();
+
+    // Threads taking part in a run(), including the caller; 1 before init().
+    unsigned int threadCount() const { return static_cast<unsigned int>(threads_.size()) + 1u; }
+
+    // Calls job(i, worker) for every i in [0, count) on the workers and the
+    // calling thread, and returns when all calls have finished. Runs from
+    // several threads are serialized; a job must not call run() itself.
+    void run(size_t count, const Job& job);
+
+private:
+    void workerLoop(unsigned int worker, uint64_t seen_serial);
+    void drain(unsigned int worker);
+
+    std::vector<std::thread> threads_;
+    std::mutex run_mutex_; // held for a whole run()
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const Job* job_;
+    size_t job_count_;
+    std::atomic<size_t> next_job_;
+    unsigned int busy_workers_;
+    uint64_t run_serial_;
+    bool stopping_;
+};
+
+} // namespace voxel
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of RaidShared.
+ */
+
+// Keyframe track compression, pose evaluation and frame baking for
+// GltfSkeleton. Kept apart from gltf_loader.cpp so it builds without
+// tinygltf (e.g. into the benchmark).
+
+#include "gltf_loader.h"
+#include "voxel_math.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+struct Float3 {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    Float3() = default;
+    Float3(float xx, float yy, float zz) : x(xx), y(yy), z(zz) {}
+};
+
+struct Float4 {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    float w = 1.0f;
+    Float4() = default;
+    Float4(float xx, float yy, float zz, float ww) : x(xx), y(yy), z(zz), w(ww) {}
+};
+
+struct Mat4f {
+    float m[16];
+};
+static_assert(sizeof(Mat4f) == sizeof(float) * 16, "GltfPoseScratch stores Mat4f as 16 packed floats");
+
+static Mat4f Mat4Identity() {
+    Mat4f out = {};
+    out.m[0] = out.m[5] = out.m[10] = out.m[15] = 1.0f;
+    return out;
+}
+
+static Mat4f Mat4Multiply(const Mat4f& a, const Mat4f& b) {
+    Mat4f r;
+    voxel::math::Mat4Mul(a.m, b.m, r.m);
+    return r;
+}
+
+static Float4 QuatNormalize(const Float4& q) {
+    const float in[4] = {q.x, q.y, q.z, q.w};
+    float out[4];
+    voxel::math::QuatNormalize(in, out);
+    return Float4{out[0], out[1], out[2], out[3]};
+}
+
+// Index k of the key pair with times[k] < t <= times[k + 1], for t strictly
+// inside the track. *cursor is the previous result for this track: it is
+// reused when t still falls in that pair or the next one (sequential
+// sampling), otherwise the pair is found by binary search.
+static size_t FindKeyframe(const std::vector<float>& times, float t, uint32_t* cursor) {
+    const size_t count = times.size();
+    size_t k = *cursor;
+    if (k + 1 < count && times[k] < t) {
+        if (t <= times[k + 1])
+            return k;
+        if (k + 2 < count && t <= times[k + 2]) {
+            *cursor = static_cast<uint32_t>(k + 1);
+            return k + 1;
+        }
+    }
+    k = static_cast<size_t>(std::lower_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+    *cursor = static_cast<uint32_t>(k);
+    return k;
+}
+
+// Key k of a translation or scale track.
+static Float3 TrackKeyVec3(const GltfAnimationTrack& track, size_t k) {
+    const uint16_t* v = &track.values[k * 3];
+    const float step = 1.0f / 65535.0f;
+    return Float3{
+        track.value_min[0] + track.value_extent[0] * ((float)v[0] * step),
+        track.value_min[1] + track.value_extent[1] * ((float)v[1] * step),
+        track.value_min[2] + track.value_extent[2] * ((float)v[2] * step),
+    };
+}
+
+// Key k of a rotation track, not renormalized.
+static void TrackKeyQuat(const GltfAnimationTrack& track, size_t k, float* out) {
+    const uint16_t* v = &track.values[k * 4];
+    for (int i = 0; i < 4; ++i)
+        out[i] = std::max((float)(int16_t)v[i] / 32767.0f, -1.0f);
+}
+
+static Float3 SampleTrackVec3(const GltfAnimationTrack& track, float t, const Float3& fallback, uint32_t* cursor) {
+    const size_t count = track.times.size();
+    if (count == 0 || track.values.size() < count * 3)
+        return fallback;
+    if (count == 1 || t <= track.times.front())
+        return TrackKeyVec3(track, 0);
+    if (t >= track.times.back())
+        return TrackKeyVec3(track, count - 1);
+    const size_t k = FindKeyframe(track.times, t, cursor);
+    const float t0 = track.times[k];
+    const float t1 = track.times[k + 1];
+    const float a = (t1 > t0) ? ((t - t0) / (t1 - t0)) : 0.0f;
+    const Float3 v0 = TrackKeyVec3(track, k);
+    const Float3 v1 = TrackKeyVec3(track, k + 1);
+    return Float3{
+        v0.x + (v1.x - v0.x) * a,
+        v0.y + (v1.y - v0.y) * a,
+        v0.z + (v1.z - v0.z) * a,
+    };
+}
+
+static Float4 SampleTrackQuat(const GltfAnimationTrack& track, float t, const Float4& fallback, uint32_t* cursor) {
+    const size_t count = track.times.size();
+    if (count == 0 || track.values.size() < count * 4)
+        return fallback;
+    float q0[4];
+    if (count == 1 || t <= track.times.front() || t >= track.times.back()) {
+        TrackKeyQuat(track, (count == 1 || t <= track.times.front()) ? 0 : count - 1, q0);
+        return QuatNormalize(Float4{q0[0], q0[1], q0[2], q0[3]});
+    }
+    const size_t k = FindKeyframe(track.times, t, cursor);
+    const float t0 = track.times[k];
+    const float t1 = track.times[k + 1];
+    const float a = (t1 > t0) ? ((t - t0) / (t1 - t0)) : 0.0f;
+    float q1[4];
+    TrackKeyQuat(track, k, q0);
+    TrackKeyQuat(track, k + 1, q1);
+    float q[4];
+    voxel::math::QuatNlerp(q0, q1, a, q);
+    return Float4{q[0], q[1], q[2], q[3]};
+}
+
+void CompressGltfAnimationTrack(const float* times,
+                                const float* values,
+                                size_t count,
+                                int components,
+                                GltfAnimationTrack* out_track) {
+    GltfAnimationTrack& track = *out_track;
+    track = GltfAnimationTrack();
+    if (count == 0)
+        return;
+    std::vector<uint16_t> quantized(count * components);
+    if (components == 4) {
+        for (size_t k = 0; k < count; ++k) {
+            float q[4];
+            voxel::math::QuatNormalize(values + k * 4, q);
+            for (int i = 0; i < 4; ++i)
+                quantized[k * 4 + i] = (uint16_t)voxel::math::PackSnorm16(q[i]);
+        }
+    } else {
+        for (int axis = 0; axis < 3; ++axis) {
+            float lo = values[axis];
+            float hi = values[axis];
+            for (size_t k = 1; k < count; ++k) {
+                lo = std::min(lo, values[k * 3 + axis]);
+                hi = std::max(hi, values[k * 3 + axis]);
+            }
+            track.value_min[axis] = lo;
+            track.value_extent[axis] = hi - lo;
+        }
+        for (size_t k = 0; k < count; ++k) {
+            for (int axis = 0; axis < 3; ++axis) {
+                const float extent = track.value_extent[axis];
+                const float u = (extent > 0.0f) ? (values[k * 3 + axis] - track.value_min[axis]) / extent : 0.0f;
+                quantized[k * 3 + axis] = (uint16_t)voxel::math::PackUnorm16(u);
+            }
+        }
+    }
+
+    auto same_key = [&](size_t a, size_t b) {
+        return std::memcmp(&quantized[a * components], &quantized[b * components], sizeof(uint16_t) * components) == 0;
+    };
+    for (size_t k = 0; k < count; ++k) {
+        if (k > 0 && k + 1 < count && same_key(k, k - 1) && same_key(k, k + 1))
+            continue;
+        track.times.push_back(times[k]);
+        track.values.insert(track.values.end(), &quantized[k * components], &quantized[(k + 1) * components]);
+    }
+    if (track.times.size() == 2 && same_key(0, count - 1)) {
+        track.times.pop_back();
+        track.values.resize(components);
+    }
+}
+
+static Mat4f ComposeTRS(const Float3& t, const Float4& r, const Float3& s) {
+    const float tv[3] = {t.x, t.y, t.z};
+    const float rv[4] = {r.x, r.y, r.z, r.w};
+    const float sv[3] = {s.x, s.y, s.z};
+    Mat4f m;
+    voxel::math::ComposeTRS(tv, rv, sv, m.m);
+    return m;
+}
+
+void EvaluateGltfPose(const GltfSkeleton& skeleton,
+                      size_t clip_index,
+                      float time,
+                      GltfPoseScratch* scratch,
+                      float* out_palette) {
+    const size_t node_count = skeleton.parents.size();
+    scratch->local.resize(node_count * 16u);
+    scratch->global.resize(node_count * 16u);
+    scratch->cursors.resize(node_count * 3u, 0u);
+    Mat4f* local = reinterpret_cast<Mat4f*>(scratch->local.data());
+    Mat4f* global = reinterpret_cast<Mat4f*>(scratch->global.data());
+    const GltfSkeletonClip* clip = (clip_index < skeleton.clips.size()) ? &skeleton.clips[clip_index] : nullptr;
+    const float t = clip ? std::min(std::max(time, 0.0f), clip->duration) : 0.0f;
+
+    for (size_t ni = 0; ni < node_count; ++ni) {
+        if (skeleton.has_matrix[ni] || !clip) {
+            std::memcpy(local[ni].m, &skeleton.rest_matrix[ni * 16u], sizeof(float) * 16);
+            continue;
+        }
+        const float* rt = &skeleton.rest_translation[ni * 3u];
+        const float* rr = &skeleton.rest_rotation[ni * 4u];
+        const float* rs = &skeleton.rest_scale[ni * 3u];
+        const GltfNodeTracks& tr = clip->tracks[ni];
+        uint32_t* cursors = &scratch->cursors[ni * 3u];
+        const Float3 tt = SampleTrackVec3(tr.translation, t, Float3{rt[0], rt[1], rt[2]}, &cursors[0]);
+        const Float4 rot = SampleTrackQuat(tr.rotation, t, Float4{rr[0], rr[1], rr[2], rr[3]}, &cursors[1]);
+        const Float3 ss = SampleTrackVec3(tr.scale, t, Float3{rs[0], rs[1], rs[2]}, &cursors[2]);
+        local[ni] = ComposeTRS(tt, rot, ss);
+    }
+
+    // node_order lists parents before children, so one pass suffices.
+    for (size_t oi = 0; oi < skeleton.node_order.size(); ++oi) {
+        const size_t ni = static_cast<size_t>(skeleton.node_order[oi]);
+        const int p = skeleton.parents[ni];
+        if (p >= 0)
+            global[ni] = Mat4Multiply(global[static_cast<size_t>(p)], local[ni]);
+        else
+            global[ni] = local[ni];
+    }
+
+    // global * inverse_bind, written straight into the palette: the four
+    // inverse-bind columns go through the matrix as one vec4 batch.
+    for (size_t ji = 0; ji < skeleton.joints.size(); ++ji) {
+        const int node_index = skeleton.joints[ji];
+        float* joint_mat = out_palette + ji * 16u;
+        if (node_index >= 0 && node_index < static_cast<int>(node_count))
+            voxel::math::Mat4MulVec4Batch(global[(size_t)node_index].m, &skeleton.inverse_bind[ji * 16u], joint_mat, 4);
+        else
+            std::memcpy(joint_mat, Mat4Identity().m, sizeof(float) * 16);
+    }
+}
+
+static const uint32_t kMinFramesPerBakeWorker = 16;
+
+// 30 FPS samples including both clip ends.
+static uint32_t BakedFrameCount(float duration) {
+    const float sample_fps = 30.0f;
+    if (duration <= 0.0001f)
+        return 1;
+    return std::max<uint32_t>(2u, static_cast<uint32_t>(std::ceil(duration * sample_fps)) + 1u);
+}
+
+static float BakedFrameTime(float duration, uint32_t frame, uint32_t frame_count) {
+    return (frame_count > 1) ? (duration * (float(frame) / float(frame_count - 1))) : 0.0f;
+}
+
+// Per-thread state of a bake.
+struct BakeWorker {
+    GltfPoseScratch scratch;
+    std::vector<float> palette; // one frame, for bakes that repack it
+};
+
+// Hands every frame in [0, frame_count) to emit(frame, worker). Frames are
+// split into contiguous ranges, one job each, so each job samples
+// monotonically and keeps its keyframe cursors warm. A frame's palette only
+// depends on its time, so the output does not depend on the thread count.
+template <typename Emit>
+static void BakeFrames(const GltfSkeleton& skeleton, uint32_t frame_count, voxel::VoxelWorkerPool* workers, Emit emit) {
+    const unsigned int thread_count = workers ? workers->threadCount() : 1u;
+    const uint32_t range_count = std::max(1u, std::min<uint32_t>(thread_count, frame_count / kMinFramesPerBakeWorker));
+    auto bake_range = [&](size_t range, unsigned int) {
+        const uint32_t begin = (uint32_t)((uint64_t)frame_count * range / range_count);
+        const uint32_t end = (uint32_t)((uint64_t)frame_count * (range + 1) / range_count);
+        BakeWorker worker;
+        worker.palette.resize(skeleton.joints.size() * 16u);
+        for (uint32_t fi = begin; fi < end; ++fi)
+            emit(fi, &worker);
+    };
+    if (workers) {
+        workers->run(range_count, bake_range);
+    } else {
+        bake_range(0, 0u);
+    }
+}
+
+// Translation bounds (min xyz, extent xyz) of the joint matrices of `clip`
+// over frame_count frames sampled at time_of(frame). Returns false if a
+// joint matrix can't be packed exactly (shear or non-uniform scale).
+template <typename TimeOf>
+static bool ClipTranslationBounds(const GltfSkeleton& skeleton,
+                                  size_t clip,
+                                  uint32_t frame_count,
+                                  TimeOf time_of,
+                                  voxel::VoxelWorkerPool* workers,
+                                  float* out_bounds) {
+    const size_t joint_count = skeleton.joints.size();
+    // Per frame: min xyz, max xyz, packable flag.
+    std::vector<float> frame_bounds(static_cast<size_t>(frame_count) * 7u);
+    BakeFrames(skeleton, frame_count, workers, [&](uint32_t fi, BakeWorker* worker) {
+        EvaluateGltfPose(skeleton, clip, time_of(fi), &worker->scratch, worker->palette.data());
+        float* fb = &frame_bounds[static_cast<size_t>(fi) * 7u];
+        fb[0] = fb[1] = fb[2] = FLT_MAX;
+        fb[3] = fb[4] = fb[5] = -FLT_MAX;
+        fb[6] = 1.0f;
+        for (size_t ji = 0; ji < joint_count; ++ji) {
+            const float* m = &worker->palette[ji * 16u];
+            for (int axis = 0; axis < 3; ++axis) {
+                fb[axis] = std::min(fb[axis], m[12 + axis]);
+                fb[3 + axis] = std::max(fb[3 + axis], m[12 + axis]);
+            }
+            float q[4];
+            float scale;
+            if (!voxel::math::DecomposeRotationScale(m, q, &scale))
+                fb[6] = 0.0f;
+        }
+    });
+    float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    bool exact = true;
+    for (uint32_t fi = 0; fi < frame_count; ++fi) {
+        const float* fb = &frame_bounds[static_cast<size_t>(fi) * 7u];
+        for (int axis = 0; axis < 3; ++axis) {
+            lo[axis] = std::min(lo[axis], fb[axis]);
+            hi[axis] = std::max(hi[axis], fb[3 + axis]);
+        }
+        exact = exact && fb[6] != 0.0f;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        if (lo[axis] > hi[axis])
+            lo[axis] = hi[axis] = 0.0f;
+        out_bounds[axis] = lo[axis];
+        out_bounds[3 + axis] = hi[axis] - lo[axis];
+    }
+    return exact;
+}
+
+bool BakeGltfSkinningFrames(const GltfSkeleton& skeleton,
+                            GltfSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers) {
+    if (!out_frames)
+        return false;
+    *out_frames = GltfSkinningFrames();
+    if (skeleton.clips.empty()) {
+        if (error)
+            *error = "No animations";
+        return false;
+    }
+
+    const float duration = skeleton.clips[0].duration;
+    const uint32_t frame_count = BakedFrameCount(duration);
+    const size_t joint_count = skeleton.joints.size();
+    out_frames->joint_count = static_cast<uint32_t>(joint_count);
+    out_frames->frame_count = frame_count;
+    out_frames->duration = duration;
+    out_frames->palettes.resize(static_cast<size_t>(frame_count) * joint_count * 16u, 0.0f);
+
+    float* palettes = out_frames->palettes.data();
+    BakeFrames(skeleton, frame_count, workers, [&](uint32_t fi, BakeWorker* worker) {
+        EvaluateGltfPose(skeleton, 0, BakedFrameTime(duration, fi, frame_count), &worker->scratch,
+                         palettes + static_cast<size_t>(fi) * joint_count * 16u);
+    });
+
+    return true;
+}
+
+bool BakeGltfSkinningFrames(const GltfSkeleton& skeleton,
+                            GltfPackedSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers) {
+    if (!out_frames)
+        return false;
+    *out_frames = GltfPackedSkinningFrames();
+    if (skeleton.clips.empty()) {
+        if (error)
+            *error = "No animations";
+        return false;
+    }
+
+    const float duration = skeleton.clips[0].duration;
+    const uint32_t frame_count = BakedFrameCount(duration);
+    const size_t joint_count = skeleton.joints.size();
+    auto time_of = [duration, frame_count](uint32_t fi) { return BakedFrameTime(duration, fi, frame_count); };
+
+    // Two passes so the float palettes are never held: bounds first, then
+    // every frame is evaluated again and packed against them.
+    float bounds[6];
+    if (!ClipTranslationBounds(skeleton, 0, frame_count, time_of, workers, bounds)) {
+        if (error)
+            *error = "Joint matrices have shear or non-uniform scale; use GltfSkinningFrames";
+        return false;
+    }
+    out_frames->joint_count = static_cast<uint32_t>(joint_count);
+    out_frames->frame_count = frame_count;
+    out_frames->duration = duration;
+    std::memcpy(out_frames->translation_bounds, bounds, sizeof(bounds));
+    out_frames->joints.resize(static_cast<size_t>(frame_count) * joint_count * 4u);
+
+    uint32_t* joints = out_frames->joints.data();
+    BakeFrames(skeleton, frame_count, workers, [&](uint32_t fi, BakeWorker* worker) {
+        EvaluateGltfPose(skeleton, 0, time_of(fi), &worker->scratch, worker->palette.data());
+        uint32_t* dst = joints + static_cast<size_t>(fi) * joint_count * 4u;
+        for (size_t ji = 0; ji < joint_count; ++ji)
+            voxel::math::PackSkinJoint(&worker->palette[ji * 16u], bounds, bounds + 3, dst + ji * 4u);
+    });
+
+    return true;
+}
+
+void UnpackGltfSkinningFrame(const GltfPackedSkinningFrames& frames, uint32_t frame, float* out_palette) {
+    if (frames.frame_count == 0 || frames.joint_count == 0)
+        return;
+    frame = std::min(frame, frames.frame_count - 1);
+    const uint32_t* src = &frames.joints[static_cast<size_t>(frame) * frames.joint_count * 4u];
+    for (uint32_t ji = 0; ji < frames.joint_count; ++ji) {
+        voxel::math::UnpackSkinJoint(src + ji * 4u, frames.translation_bounds, frames.translation_bounds + 3,
+                                     out_palette + static_cast<size_t>(ji) * 16u);
+    }
+}
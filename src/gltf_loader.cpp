@@ -5,6 +5,7 @@
  */
 
 #include "gltf_loader.h"
+#include "voxel_math.h"
 
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
@@ -14,12 +15,15 @@
 #include <vector>
 #include <cmath>
 #include <map>
+#include <queue>
 #include <unordered_map>
 #include <algorithm>
-#include <functional>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cstdint>
 #include <cctype>
+#include <cfloat>
 #include <sys/stat.h>
 
 struct AnimationCacheEntry {
@@ -256,148 +260,208 @@ static int FindMeshIndexByName(const tinygltf::Model& model, const std::string&
 }
 
 
-static bool ReadAccessor(const tinygltf::Model& model,
-                         const tinygltf::Accessor& accessor,
-                         std::vector<float>* out,
-                         int expected_components) {
-    if (!out)
-        return false;
-    out->clear();
-    if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
-        return false;
-    if (accessor.type == TINYGLTF_TYPE_SCALAR && expected_components != 1)
-        return false;
-    if (accessor.type == TINYGLTF_TYPE_VEC2 && expected_components != 2)
-        return false;
-    if (accessor.type == TINYGLTF_TYPE_VEC3 && expected_components != 3)
-        return false;
-    if (accessor.type == TINYGLTF_TYPE_VEC4 && expected_components != 4)
-        return false;
+// Strided view of an accessor inside its tinygltf buffer. Elements are read
+// in place, so attributes go from the glTF buffer to their destination in a
+// single copy.
+struct AccessorView {
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    size_t size = 0; // readable bytes from data: stride * (count - 1) + element size
+    int components = 0;
+    int component_type = -1;
+    bool normalized = false;
+};
 
-    if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()))
-        return false;
-    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-    if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size()))
-        return false;
-    const tinygltf::Buffer& buffer = model.buffers[view.buffer];
-    size_t stride = accessor.ByteStride(view);
-    if (stride == 0)
-        stride = expected_components * sizeof(float);
-    const size_t base_offset = static_cast<size_t>(view.byteOffset + accessor.byteOffset);
-    const size_t required_bytes = (accessor.count == 0) ? 0 : (stride * (accessor.count - 1) + expected_components * sizeof(float));
-    if (base_offset + required_bytes > buffer.data.size())
-        return false;
-    const unsigned char* data = buffer.data.data() + base_offset;
+static size_t ComponentSize(int component_type) {
+    switch (component_type) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return 1;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return 2;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case TINYGLTF_COMPONENT_TYPE_FLOAT: return 4;
+        default: return 0;
+    }
+}
 
-    out->resize(accessor.count * expected_components);
-    for (size_t i = 0; i < accessor.count; ++i) {
-        const float* src = reinterpret_cast<const float*>(data + stride * i);
-        for (int c = 0; c < expected_components; ++c)
-            (*out)[i * expected_components + c] = src[c];
+static int TypeComponents(int type) {
+    switch (type) {
+        case TINYGLTF_TYPE_SCALAR: return 1;
+        case TINYGLTF_TYPE_VEC2: return 2;
+        case TINYGLTF_TYPE_VEC3: return 3;
+        case TINYGLTF_TYPE_VEC4: return 4;
+        case TINYGLTF_TYPE_MAT4: return 16;
+        default: return 0;
     }
-    return true;
 }
 
-static bool ReadIndices(const tinygltf::Model& model,
-                        const tinygltf::Accessor& accessor,
-                        std::vector<uint32_t>* out) {
-    if (!out)
+// Fails unless the accessor exists, has `components` components and all of
+// its elements lie inside the buffer.
+static bool MakeAccessorView(const tinygltf::Model& model, int accessor_index, int components, AccessorView* out) {
+    *out = AccessorView();
+    if (accessor_index < 0 || accessor_index >= static_cast<int>(model.accessors.size()))
+        return false;
+    const tinygltf::Accessor& accessor = model.accessors[accessor_index];
+    const size_t component_size = ComponentSize(accessor.componentType);
+    if (component_size == 0 || TypeComponents(accessor.type) != components)
         return false;
-    out->clear();
     if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()))
         return false;
     const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
     if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size()))
         return false;
     const tinygltf::Buffer& buffer = model.buffers[view.buffer];
-    size_t stride = accessor.ByteStride(view);
-    size_t component = 0;
-    switch (accessor.componentType) {
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: component = 1; break;
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: component = 2; break;
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: component = 4; break;
-        default: return false;
-    }
-    if (stride == 0) {
-        size_t comps = 1;
-        stride = component * comps;
-    }
+    const int byte_stride = accessor.ByteStride(view);
+    if (byte_stride < 0)
+        return false;
+    const size_t element_size = component_size * components;
+    const size_t stride = (byte_stride == 0) ? element_size : static_cast<size_t>(byte_stride);
     const size_t base_offset = static_cast<size_t>(view.byteOffset + accessor.byteOffset);
-    const size_t required_bytes = (accessor.count == 0) ? 0 : (stride * (accessor.count - 1) + component);
+    const size_t required_bytes = (accessor.count == 0) ? 0 : (stride * (accessor.count - 1) + element_size);
     if (base_offset + required_bytes > buffer.data.size())
         return false;
-    const unsigned char* data = buffer.data.data() + base_offset;
-
-    out->resize(accessor.count);
-    for (size_t i = 0; i < accessor.count; ++i) {
-        const unsigned char* src = data + stride * i;
-        uint32_t value = 0;
-        if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-            value = *reinterpret_cast<const uint16_t*>(src);
-        } else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-            value = *reinterpret_cast<const uint32_t*>(src);
-        } else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-            value = *reinterpret_cast<const uint8_t*>(src);
-        } else {
-            return false;
+    out->data = buffer.data.data() + base_offset;
+    out->count = accessor.count;
+    out->stride = stride;
+    out->size = required_bytes;
+    out->components = components;
+    out->component_type = accessor.componentType;
+    out->normalized = accessor.normalized;
+    return true;
+}
+
+// Float, or byte/short data that is dequantized on read (normalized
+// accessors and KHR_mesh_quantization).
+static bool MakeFloatView(const tinygltf::Model& model, int accessor_index, int components, AccessorView* out) {
+    return MakeAccessorView(model, accessor_index, components, out) &&
+           out->component_type != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+}
+
+// Plain (non-normalized) integer data. KHR_mesh_quantization scales such
+// positions back through the node transform, which LoadGltfMesh does not
+// apply, so they are rejected for POSITION and NORMAL.
+static bool IsUnnormalizedInteger(const AccessorView& view) {
+    return view.component_type != TINYGLTF_COMPONENT_TYPE_FLOAT && !view.normalized;
+}
+
+static bool MakeUintView(const tinygltf::Model& model, int accessor_index, int components, AccessorView* out) {
+    return MakeAccessorView(model, accessor_index, components, out) &&
+           (out->component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE ||
+            out->component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ||
+            out->component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+}
+
+// Elements [first, first + count) of a float view as floats, element k
+// written to out + k * out_stride. Integer components go through the SIMD
+// kernel; normalized ones map to [0, 1] or [-1, 1] as glTF specifies.
+static void ReadFloatElements(const AccessorView& view, size_t first, size_t count, float* out, size_t out_stride) {
+    if (count == 0)
+        return;
+    const unsigned char* src = view.data + view.stride * first;
+    if (view.component_type == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+        const size_t element_size = sizeof(float) * view.components;
+        if (view.stride == element_size && out_stride == (size_t)view.components) {
+            std::memcpy(out, src, element_size * count);
+            return;
         }
-        (*out)[i] = value;
+        for (size_t i = 0; i < count; ++i)
+            std::memcpy(out + i * out_stride, src + view.stride * i, element_size);
+        return;
     }
-    return true;
+    voxel::math::IntComponentType type = voxel::math::kComponentUint8;
+    float scale = 1.0f;
+    switch (view.component_type) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            type = voxel::math::kComponentInt8;
+            scale = 1.0f / 127.0f;
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            type = voxel::math::kComponentUint8;
+            scale = 1.0f / 255.0f;
+            break;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            type = voxel::math::kComponentInt16;
+            scale = 1.0f / 32767.0f;
+            break;
+        default:
+            type = voxel::math::kComponentUint16;
+            scale = 1.0f / 65535.0f;
+            break;
+    }
+    if (!view.normalized)
+        scale = 1.0f;
+    const float min_value = view.normalized ? -1.0f : -FLT_MAX;
+    voxel::math::IntRowsToFloat(src, view.stride, view.size - view.stride * first, count, view.components, type, scale,
+                                min_value, out, out_stride);
 }
 
-static bool ReadAccessorUint4(const tinygltf::Model& model,
-                              const tinygltf::Accessor& accessor,
-                              std::vector<uint32_t>* out) {
+// Element `index` of a float view; writes view.components floats.
+static void ReadFloatElement(const AccessorView& view, size_t index, float* out) {
+    ReadFloatElements(view, index, 1, out, view.components);
+}
+
+// Writes `count` elements of the view to out + k * out_stride: the first
+// `count` in one batch, or the elements named by `corners` when a primitive
+// is expanded per triangle corner.
+static void GatherFloatElements(const AccessorView& view, const uint32_t* corners, size_t count, float* out,
+                                size_t out_stride) {
+    if (!corners) {
+        ReadFloatElements(view, 0, count, out, out_stride);
+        return;
+    }
+    for (size_t k = 0; k < count; ++k)
+        ReadFloatElements(view, corners[k], 1, out + k * out_stride, out_stride);
+}
+
+static uint32_t ReadUintComponent(const AccessorView& view, size_t index, int component) {
+    const unsigned char* src = view.data + view.stride * index;
+    if (view.component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE)
+        return src[component];
+    if (view.component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+        uint16_t value = 0;
+        std::memcpy(&value, src + 2 * component, sizeof(value));
+        return value;
+    }
+    uint32_t value = 0;
+    std::memcpy(&value, src + 4 * component, sizeof(value));
+    return value;
+}
+
+// Float view of a primitive attribute covering at least `vertex_count`
+// vertices; false if the attribute is missing or unusable.
+static bool FindFloatAttribute(const tinygltf::Model& model,
+                               const tinygltf::Primitive& prim,
+                               const char* name,
+                               int components,
+                               size_t vertex_count,
+                               AccessorView* out) {
+    std::map<std::string, int>::const_iterator it = prim.attributes.find(name);
+    return it != prim.attributes.end() && MakeFloatView(model, it->second, components, out) && out->count >= vertex_count;
+}
+
+static bool ReadAccessor(const tinygltf::Model& model,
+                         int accessor_index,
+                         std::vector<float>* out,
+                         int expected_components) {
     if (!out)
         return false;
     out->clear();
-    if (accessor.type != TINYGLTF_TYPE_VEC4)
-        return false;
-    if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()))
+    AccessorView view;
+    if (!MakeFloatView(model, accessor_index, expected_components, &view))
         return false;
-    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-    if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size()))
-        return false;
-    const tinygltf::Buffer& buffer = model.buffers[view.buffer];
-    size_t component = 0;
-    switch (accessor.componentType) {
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: component = 1; break;
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: component = 2; break;
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: component = 4; break;
-        default: return false;
-    }
-    size_t stride = accessor.ByteStride(view);
-    if (stride == 0)
-        stride = component * 4;
-    const size_t base_offset = static_cast<size_t>(view.byteOffset + accessor.byteOffset);
-    const size_t required_bytes = (accessor.count == 0) ? 0 : (stride * (accessor.count - 1) + component * 4);
-    if (base_offset + required_bytes > buffer.data.size())
-        return false;
-    const unsigned char* data = buffer.data.data() + base_offset;
-    out->resize(accessor.count * 4);
-    for (size_t i = 0; i < accessor.count; ++i) {
-        const unsigned char* src = data + stride * i;
-        for (int c = 0; c < 4; ++c) {
-            const unsigned char* comp_src = src + c * component;
-            uint32_t value = 0;
-            if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE)
-                value = *reinterpret_cast<const uint8_t*>(comp_src);
-            else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-                value = *reinterpret_cast<const uint16_t*>(comp_src);
-            else
-                value = *reinterpret_cast<const uint32_t*>(comp_src);
-            (*out)[i * 4 + c] = value;
-        }
-    }
+    out->resize(view.count * expected_components);
+    ReadFloatElements(view, 0, view.count, out->data(), expected_components);
     return true;
 }
 
-static void ComputeNormals(const std::vector<float>& positions,
-                           std::vector<float>* normals) {
+// Flat normals for the de-indexed triangles starting at vertex `first`.
+static void ComputeFlatNormals(const std::vector<float>& positions,
+                               size_t first,
+                               std::vector<float>* normals) {
     size_t count = positions.size() / 3;
-    normals->assign(count * 3, 0.0f);
-    for (size_t i = 0; i + 2 < count; i += 3) {
+    normals->resize(count * 3, 0.0f);
+    for (size_t i = first; i + 2 < count; i += 3) {
         const float* p0 = &positions[i * 3];
         const float* p1 = &positions[(i + 1) * 3];
         const float* p2 = &positions[(i + 2) * 3];
@@ -424,6 +488,192 @@ static void ComputeNormals(const std::vector<float>& positions,
     }
 }
 
+static const int kVertexCacheSize = 32;
+static const uint32_t kVertexValenceTableSize = 64;
+
+// Forsyth's two score terms, tabulated once instead of calling std::pow on
+// every update: by LRU cache position and by remaining triangle count.
+struct VertexCacheScoreTables {
+    float cache[kVertexCacheSize];
+    float valence[kVertexValenceTableSize];
+
+    VertexCacheScoreTables() {
+        for (int k = 0; k < kVertexCacheSize; ++k) {
+            // The three vertices of the last triangle score lower on purpose,
+            // so the next triangle does not simply reuse the same edge.
+            if (k < 3) {
+                cache[k] = 0.75f;
+            } else {
+                const float scale = 1.0f / (float)(kVertexCacheSize - 3);
+                cache[k] = std::pow(1.0f - (float)(k - 3) * scale, 1.5f);
+            }
+        }
+        valence[0] = 0.0f;
+        for (uint32_t r = 1; r < kVertexValenceTableSize; ++r)
+            valence[r] = ValenceScore(r);
+    }
+
+    // Favour vertices with few triangles left so they leave the cache for good.
+    static float ValenceScore(uint32_t remaining_triangles) {
+        return 2.0f * std::pow((float)remaining_triangles, -0.5f);
+    }
+
+    float valenceScore(uint32_t remaining_triangles) const {
+        return (remaining_triangles < kVertexValenceTableSize) ? valence[remaining_triangles] : ValenceScore(remaining_triangles);
+    }
+
+    float score(int cache_position, uint32_t remaining_triangles) const {
+        if (remaining_triangles == 0)
+            return -1.0f;
+        return ((cache_position >= 0) ? cache[cache_position] : 0.0f) + valenceScore(remaining_triangles);
+    }
+};
+
+static const VertexCacheScoreTables& VertexCacheScores() {
+    static const VertexCacheScoreTables tables;
+    return tables;
+}
+
+// Reorders triangles for the post-transform vertex cache (Forsyth, "Linear-
+// speed vertex cache optimisation"): greedily emits the triangle whose
+// vertices score best against a simulated LRU cache of kVertexCacheSize.
+static void OptimizeVertexCache(std::vector<uint32_t>* indices, size_t vertex_count) {
+    const size_t tri_count = indices->size() / 3;
+    if (tri_count < 2)
+        return;
+    const std::vector<uint32_t>& in = *indices;
+    const VertexCacheScoreTables& scores = VertexCacheScores();
+
+    // Triangles of each vertex, packed; the first `remaining[v]` entries of a
+    // vertex's range are the ones not emitted yet.
+    std::vector<uint32_t> tri_offset(vertex_count + 1, 0);
+    for (size_t i = 0; i < tri_count * 3; ++i)
+        tri_offset[in[i] + 1] += 1;
+    for (size_t v = 0; v < vertex_count; ++v)
+        tri_offset[v + 1] += tri_offset[v];
+    std::vector<uint32_t> vertex_tris(tri_count * 3);
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t t = 0; t < tri_count; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            const uint32_t v = in[t * 3 + c];
+            vertex_tris[tri_offset[v] + remaining[v]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v)
+        vertex_score[v] = scores.score(-1, remaining[v]);
+    std::vector<float> tri_score(tri_count);
+    std::vector<char> emitted(tri_count, 0);
+    size_t best = 0;
+    for (size_t t = 0; t < tri_count; ++t) {
+        tri_score[t] = vertex_score[in[t * 3]] + vertex_score[in[t * 3 + 1]] + vertex_score[in[t * 3 + 2]];
+        if (tri_score[t] > tri_score[best])
+            best = t;
+    }
+
+    // Restart candidates for when no cached vertex has a live triangle. All
+    // live triangles are then outside the cache, so their score only depends
+    // on the remaining counts of their vertices. A count only drops while
+    // its vertex is cached, so a triangle is pushed again with its new score
+    // when one of its vertices is evicted; popped entries whose score no
+    // longer matches are stale.
+    typedef std::pair<float, uint32_t> RestartEntry;
+    std::vector<RestartEntry> initial(tri_count);
+    for (size_t t = 0; t < tri_count; ++t)
+        initial[t] = RestartEntry(tri_score[t], (uint32_t)t);
+    std::priority_queue<RestartEntry> restart(std::less<RestartEntry>(), std::move(initial));
+    auto uncached_score = [&](uint32_t t) {
+        return scores.valenceScore(remaining[in[t * 3]]) + scores.valenceScore(remaining[in[t * 3 + 1]]) +
+               scores.valenceScore(remaining[in[t * 3 + 2]]);
+    };
+
+    std::vector<uint32_t> out;
+    out.reserve(tri_count * 3);
+    uint32_t cache[kVertexCacheSize + 3];
+    int cache_count = 0;
+    while (out.size() < tri_count * 3) {
+        if (best >= tri_count) {
+            // Nothing in the cache touches a live triangle: restart at the
+            // best-scoring one.
+            while (!restart.empty()) {
+                const RestartEntry top = restart.top();
+                restart.pop();
+                if (!emitted[top.second] && top.first == uncached_score(top.second)) {
+                    best = top.second;
+                    break;
+                }
+            }
+        }
+        emitted[best] = 1;
+        const uint32_t* tri = &in[best * 3];
+        for (int c = 0; c < 3; ++c) {
+            const uint32_t v = tri[c];
+            out.push_back(v);
+            uint32_t* list = &vertex_tris[tri_offset[v]];
+            for (uint32_t k = 0; k < remaining[v]; ++k) {
+                if (list[k] == best) {
+                    list[k] = list[--remaining[v]];
+                    break;
+                }
+            }
+        }
+
+        uint32_t next_cache[kVertexCacheSize + 3];
+        int next_count = 0;
+        for (int c = 0; c < 3; ++c)
+            next_cache[next_count++] = tri[c];
+        for (int k = 0; k < cache_count; ++k) {
+            const uint32_t v = cache[k];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                next_cache[next_count++] = v;
+        }
+        for (int k = 0; k < next_count; ++k) {
+            const uint32_t v = next_cache[k];
+            cache_position[v] = (k < kVertexCacheSize) ? k : -1;
+            vertex_score[v] = scores.score(cache_position[v], remaining[v]);
+        }
+        for (int k = kVertexCacheSize; k < next_count; ++k) {
+            const uint32_t* list = &vertex_tris[tri_offset[next_cache[k]]];
+            for (uint32_t n = 0; n < remaining[next_cache[k]]; ++n)
+                restart.push(RestartEntry(uncached_score(list[n]), list[n]));
+        }
+
+        best = tri_count;
+        float best_score = -1.0f;
+        for (int k = 0; k < next_count; ++k) {
+            const uint32_t v = next_cache[k];
+            const uint32_t* list = &vertex_tris[tri_offset[v]];
+            for (uint32_t n = 0; n < remaining[v]; ++n) {
+                const uint32_t t = list[n];
+                tri_score[t] = vertex_score[in[t * 3]] + vertex_score[in[t * 3 + 1]] + vertex_score[in[t * 3 + 2]];
+                if (tri_score[t] > best_score) {
+                    best_score = tri_score[t];
+                    best = t;
+                }
+            }
+        }
+        cache_count = std::min(next_count, kVertexCacheSize);
+        std::memcpy(cache, next_cache, sizeof(uint32_t) * (size_t)cache_count);
+    }
+    indices->swap(out);
+}
+
+template <typename T>
+static void RemapAttribute(std::vector<T>* data, size_t components, const std::vector<uint32_t>& remap, size_t new_count) {
+    if (data->empty())
+        return;
+    std::vector<T> out(new_count * components);
+    for (size_t v = 0; v < remap.size(); ++v) {
+        if (remap[v] == UINT32_MAX)
+            continue;
+        for (size_t c = 0; c < components; ++c)
+            out[remap[v] * components + c] = (*data)[v * components + c];
+    }
+    data->swap(out);
+}
+
 bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* error) {
     if (!out_mesh)
         return false;
@@ -456,6 +706,7 @@ bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* erro
     std::vector<float> out_col;
     std::vector<uint32_t> out_joints;
     std::vector<float> out_weights;
+    std::vector<uint32_t> out_indices;
     bool any_uv = false;
 
     if (MeshDebugEnabled()) {
@@ -486,6 +737,7 @@ bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* erro
         }
 
         bool any_primitive_loaded = false;
+        bool integer_positions_rejected = false;
         for (size_t mi = 0; mi < mesh_indices.size(); ++mi) {
             const int mesh_index = mesh_indices[mi];
             if (mesh_index < 0 || mesh_index >= static_cast<int>(model.meshes.size()))
@@ -508,99 +760,108 @@ bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* erro
                     std::fprintf(stderr, "glTF baseColor texture: %s\n", tex_path.c_str());
                 }
             }
-            auto it_pos = prim.attributes.find("POSITION");
-            if (it_pos == prim.attributes.end())
+            AccessorView pos_view;
+            if (!FindFloatAttribute(model, prim, "POSITION", 3, 0, &pos_view))
                 continue;
-
-            std::vector<float> positions;
-            if (!ReadAccessor(model, model.accessors[it_pos->second], &positions, 3))
+            if (IsUnnormalizedInteger(pos_view)) {
+                std::fprintf(stderr,
+                             "glTF mesh '%s': primitive %zu has non-normalized integer positions (node transforms are not applied), skipped\n",
+                             mesh.name.c_str(), prim_i);
+                integer_positions_rejected = true;
+                continue;
+            }
+            const size_t vertex_count = pos_view.count;
+
+            AccessorView norm_view;
+            AccessorView uv_view;
+            AccessorView col_view;
+            AccessorView joint_view;
+            AccessorView weight_view;
+            bool has_normals = FindFloatAttribute(model, prim, "NORMAL", 3, vertex_count, &norm_view);
+            if (has_normals && IsUnnormalizedInteger(norm_view)) {
+                std::fprintf(stderr,
+                             "glTF mesh '%s': primitive %zu has non-normalized integer normals, using flat normals\n",
+                             mesh.name.c_str(), prim_i);
+                has_normals = false;
+            }
+            const bool has_uvs = FindFloatAttribute(model, prim, "TEXCOORD_0", 2, vertex_count, &uv_view);
+            const bool has_colors = FindFloatAttribute(model, prim, "COLOR_0", 4, vertex_count, &col_view) ||
+                                    FindFloatAttribute(model, prim, "COLOR_0", 3, vertex_count, &col_view);
+            std::map<std::string, int>::const_iterator it_joints = prim.attributes.find("JOINTS_0");
+            const bool has_skin = it_joints != prim.attributes.end() &&
+                                  MakeUintView(model, it_joints->second, 4, &joint_view) &&
+                                  joint_view.count >= vertex_count &&
+                                  FindFloatAttribute(model, prim, "WEIGHTS_0", 4, vertex_count, &weight_view);
+            if (has_uvs)
+                any_uv = true;
+
+            AccessorView index_view;
+            const bool indexed = (prim.indices >= 0);
+            if (indexed && !MakeUintView(model, prim.indices, 1, &index_view))
+                continue;
+            const size_t corner_count = indexed ? index_view.count : vertex_count;
+            const size_t index_start = out_indices.size();
+            out_indices.resize(index_start + corner_count);
+            bool indices_ok = true;
+            for (size_t i = 0; i < corner_count; ++i) {
+                const uint32_t index = indexed ? ReadUintComponent(index_view, i, 0) : (uint32_t)i;
+                indices_ok = indices_ok && index < vertex_count;
+                out_indices[index_start + i] = index;
+            }
+            if (!indices_ok) {
+                out_indices.resize(index_start);
+                std::fprintf(stderr, "glTF mesh '%s': primitive %zu has out of range indices, skipped\n",
+                             mesh.name.c_str(), prim_i);
                 continue;
-
-            std::vector<float> normals;
-            auto it_norm = prim.attributes.find("NORMAL");
-            if (it_norm != prim.attributes.end())
-                ReadAccessor(model, model.accessors[it_norm->second], &normals, 3);
-
-            std::vector<float> uvs;
-            auto it_uv = prim.attributes.find("TEXCOORD_0");
-            if (it_uv != prim.attributes.end()) {
-                if (ReadAccessor(model, model.accessors[it_uv->second], &uvs, 2))
-                    any_uv = true;
             }
 
-            std::vector<float> colors;
-            auto it_col = prim.attributes.find("COLOR_0");
-            if (it_col != prim.attributes.end())
-                ReadAccessor(model, model.accessors[it_col->second], &colors, 4);
-
-            std::vector<uint32_t> joints;
-            auto it_joints = prim.attributes.find("JOINTS_0");
-            if (it_joints != prim.attributes.end())
-                ReadAccessorUint4(model, model.accessors[it_joints->second], &joints);
-
-            std::vector<float> weights;
-            auto it_weights = prim.attributes.find("WEIGHTS_0");
-            if (it_weights != prim.attributes.end())
-                ReadAccessor(model, model.accessors[it_weights->second], &weights, 4);
-
-            std::vector<uint32_t> indices;
-            bool has_indices = (prim.indices >= 0);
-            if (has_indices)
-                ReadIndices(model, model.accessors[prim.indices], &indices);
-
-            auto push_vertex = [&](uint32_t idx) {
-                out_pos.push_back(positions[idx * 3 + 0]);
-                out_pos.push_back(positions[idx * 3 + 1]);
-                out_pos.push_back(positions[idx * 3 + 2]);
-                if (!normals.empty()) {
-                    out_norm.push_back(normals[idx * 3 + 0]);
-                    out_norm.push_back(normals[idx * 3 + 1]);
-                    out_norm.push_back(normals[idx * 3 + 2]);
-                }
-                if (!uvs.empty()) {
-                    out_uv.push_back(uvs[idx * 2 + 0]);
-                    out_uv.push_back(uvs[idx * 2 + 1]);
-                }
-                if (!colors.empty()) {
-                    out_col.push_back(colors[idx * 4 + 0]);
-                    out_col.push_back(colors[idx * 4 + 1]);
-                    out_col.push_back(colors[idx * 4 + 2]);
-                    out_col.push_back(colors[idx * 4 + 3]);
-                }
-                if (!joints.empty() && !weights.empty()) {
-                    out_joints.push_back(joints[idx * 4 + 0]);
-                    out_joints.push_back(joints[idx * 4 + 1]);
-                    out_joints.push_back(joints[idx * 4 + 2]);
-                    out_joints.push_back(joints[idx * 4 + 3]);
-                    out_weights.push_back(weights[idx * 4 + 0]);
-                    out_weights.push_back(weights[idx * 4 + 1]);
-                    out_weights.push_back(weights[idx * 4 + 2]);
-                    out_weights.push_back(weights[idx * 4 + 3]);
-                } else {
-                    out_joints.push_back(0);
-                    out_joints.push_back(0);
-                    out_joints.push_back(0);
-                    out_joints.push_back(0);
-                    out_weights.push_back(1.0f);
-                    out_weights.push_back(0.0f);
-                    out_weights.push_back(0.0f);
-                    out_weights.push_back(0.0f);
+            // Primitives with normals keep their shared vertices and the glTF
+            // indices are rebased onto the merged vertex list. Without normals
+            // the primitive is shaded flat, which needs a vertex per triangle
+            // corner. Primitives without UVs or colours get the renderer
+            // defaults wherever another primitive of the mesh has them.
+            const uint32_t base = (uint32_t)(out_pos.size() / 3);
+            const size_t new_count = has_normals ? vertex_count : corner_count;
+            const size_t total = base + new_count;
+            out_pos.resize(total * 3);
+            out_norm.resize(total * 3);
+            if (has_uvs || !out_uv.empty())
+                out_uv.resize(total * 2, 0.0f);
+            if (has_colors || !out_col.empty())
+                out_col.resize(total * 4, 1.0f);
+            out_joints.resize(total * 4, 0u);
+            out_weights.resize(total * 4, 0.0f);
+            const uint32_t* corners = has_normals ? nullptr : out_indices.data() + index_start;
+            GatherFloatElements(pos_view, corners, new_count, out_pos.data() + base * 3, 3);
+            if (has_normals)
+                GatherFloatElements(norm_view, nullptr, new_count, out_norm.data() + base * 3, 3);
+            if (has_uvs)
+                GatherFloatElements(uv_view, corners, new_count, out_uv.data() + base * 2, 2);
+            if (has_colors)
+                GatherFloatElements(col_view, corners, new_count, out_col.data() + base * 4, 4); // RGB keeps alpha 1
+            if (has_skin)
+                GatherFloatElements(weight_view, corners, new_count, out_weights.data() + base * 4, 4);
+            for (size_t k = 0; k < new_count; ++k) {
+                const size_t dst = base + k;
+                if (!has_skin) {
+                    out_weights[dst * 4] = 1.0f;
+                    continue;
                 }
-            };
-
-            if (has_indices) {
-                for (size_t i = 0; i < indices.size(); ++i)
-                    push_vertex(indices[i]);
-            } else {
-                for (size_t i = 0; i < positions.size() / 3; ++i)
-                    push_vertex((uint32_t)i);
+                const uint32_t src = corners ? corners[k] : (uint32_t)k;
+                for (int c = 0; c < 4; ++c)
+                    out_joints[dst * 4 + c] = ReadUintComponent(joint_view, src, c);
             }
-                any_primitive_loaded = true;
+            for (size_t i = index_start; i < out_indices.size(); ++i)
+                out_indices[i] = base + (has_normals ? out_indices[i] : (uint32_t)(i - index_start));
+            if (!has_normals)
+                ComputeFlatNormals(out_pos, base, &out_norm);
+            any_primitive_loaded = true;
             }
         }
         if (!any_primitive_loaded) {
             if (error)
-                *error = "Missing POSITION";
+                *error = integer_positions_rejected ? "Non-normalized integer POSITION is not supported"
+                                                    : "Missing POSITION";
             return false;
         }
     }
@@ -608,9 +869,25 @@ bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* erro
     if (any_uv)
         out_mesh->has_uv = true;
 
-    if (out_norm.empty()) {
-        ComputeNormals(out_pos, &out_norm);
+    const size_t vertex_count = out_pos.size() / 3;
+
+    OptimizeVertexCache(&out_indices, vertex_count);
+    // Renumber vertices in first-use order so the fetches follow the
+    // triangle order; vertices no triangle references are dropped.
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    uint32_t used_count = 0;
+    for (size_t i = 0; i < out_indices.size(); ++i) {
+        uint32_t& index = out_indices[i];
+        if (remap[index] == UINT32_MAX)
+            remap[index] = used_count++;
+        index = remap[index];
     }
+    RemapAttribute(&out_pos, 3, remap, used_count);
+    RemapAttribute(&out_norm, 3, remap, used_count);
+    RemapAttribute(&out_uv, 2, remap, used_count);
+    RemapAttribute(&out_col, 4, remap, used_count);
+    RemapAttribute(&out_joints, 4, remap, used_count);
+    RemapAttribute(&out_weights, 4, remap, used_count);
 
     // Center block models if they are in 0..1 range.
     float min_x = 1e9f, min_y = 1e9f, min_z = 1e9f;
@@ -632,12 +909,13 @@ bool LoadGltfMesh(const std::string& path, GltfMesh* out_mesh, std::string* erro
         }
     }
 
-    out_mesh->mesh.positions = out_pos;
-    out_mesh->mesh.normals = out_norm;
-    out_mesh->mesh.uvs = out_uv;
-    out_mesh->mesh.colors = out_col;
-    out_mesh->mesh.joints = out_joints;
-    out_mesh->mesh.weights = out_weights;
+    out_mesh->mesh.positions.swap(out_pos);
+    out_mesh->mesh.normals.swap(out_norm);
+    out_mesh->mesh.uvs.swap(out_uv);
+    out_mesh->mesh.colors.swap(out_col);
+    out_mesh->mesh.joints.swap(out_joints);
+    out_mesh->mesh.weights.swap(out_weights);
+    out_mesh->mesh.indices.swap(out_indices);
     return true;
 }
 
@@ -647,228 +925,16 @@ static float SampleAnimationDuration(const tinygltf::Model& model, const tinyglt
         if (channel.sampler < 0 || channel.sampler >= static_cast<int>(anim.samplers.size()))
             continue;
         const tinygltf::AnimationSampler& sampler = anim.samplers[channel.sampler];
-        if (sampler.input < 0 || sampler.input >= static_cast<int>(model.accessors.size()))
-            continue;
-        const tinygltf::Accessor& accessor = model.accessors[sampler.input];
-        if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()))
-            continue;
-        const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-        if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size()))
-            continue;
-        const tinygltf::Buffer& buffer = model.buffers[view.buffer];
-        size_t stride = accessor.ByteStride(view);
-        if (stride == 0)
-            stride = sizeof(float);
-        if (accessor.count == 0)
+        AccessorView times;
+        if (!MakeFloatView(model, sampler.input, 1, &times) || times.count == 0)
             continue;
-        const size_t base_offset = static_cast<size_t>(view.byteOffset + accessor.byteOffset);
-        const size_t required_bytes = stride * (accessor.count - 1) + sizeof(float);
-        if (base_offset + required_bytes > buffer.data.size())
-            continue;
-        const unsigned char* data = buffer.data.data() + base_offset;
-        const float* last = reinterpret_cast<const float*>(data + stride * (accessor.count - 1));
-        duration = std::max(duration, *last);
+        float last = 0.0f;
+        ReadFloatElement(times, times.count - 1, &last);
+        duration = std::max(duration, last);
     }
     return duration;
 }
 
-struct AnimVec3Track {
-    std::vector<float> times;
-    std::vector<float> values; // xyz per key
-};
-
-struct AnimQuatTrack {
-    std::vector<float> times;
-    std::vector<float> values; // xyzw per key
-};
-
-struct NodeAnimTracks {
-    AnimVec3Track translation;
-    AnimQuatTrack rotation;
-    AnimVec3Track scale;
-};
-
-struct Float3 {
-    float x = 0.0f;
-    float y = 0.0f;
-    float z = 0.0f;
-    Float3() = default;
-    Float3(float xx, float yy, float zz) : x(xx), y(yy), z(zz) {}
-};
-
-struct Float4 {
-    float x = 0.0f;
-    float y = 0.0f;
-    float z = 0.0f;
-    float w = 1.0f;
-    Float4() = default;
-    Float4(float xx, float yy, float zz, float ww) : x(xx), y(yy), z(zz), w(ww) {}
-};
-
-struct Mat4f {
-    float m[16];
-};
-
-static Mat4f Mat4Identity() {
-    Mat4f out = {};
-    out.m[0] = out.m[5] = out.m[10] = out.m[15] = 1.0f;
-    return out;
-}
-
-static Mat4f Mat4Multiply(const Mat4f& a, const Mat4f& b) {
-    Mat4f r = {};
-    for (int col = 0; col < 4; ++col) {
-        for (int row = 0; row < 4; ++row) {
-            r.m[col * 4 + row] =
-                a.m[0 * 4 + row] * b.m[col * 4 + 0] +
-                a.m[1 * 4 + row] * b.m[col * 4 + 1] +
-                a.m[2 * 4 + row] * b.m[col * 4 + 2] +
-                a.m[3 * 4 + row] * b.m[col * 4 + 3];
-        }
-    }
-    return r;
-}
-
-static Mat4f Mat4Translate(const Float3& t) {
-    Mat4f m = Mat4Identity();
-    m.m[12] = t.x;
-    m.m[13] = t.y;
-    m.m[14] = t.z;
-    return m;
-}
-
-static Mat4f Mat4Scale(const Float3& s) {
-    Mat4f m = {};
-    m.m[0] = s.x;
-    m.m[5] = s.y;
-    m.m[10] = s.z;
-    m.m[15] = 1.0f;
-    return m;
-}
-
-static Float4 QuatNormalize(const Float4& q) {
-    const float len = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
-    if (len <= 1e-8f)
-        return Float4{0.0f, 0.0f, 0.0f, 1.0f};
-    const float inv = 1.0f / len;
-    return Float4{q.x * inv, q.y * inv, q.z * inv, q.w * inv};
-}
-
-static Mat4f Mat4FromQuat(const Float4& q_in) {
-    const Float4 q = QuatNormalize(q_in);
-    const float x = q.x;
-    const float y = q.y;
-    const float z = q.z;
-    const float w = q.w;
-    Mat4f m = Mat4Identity();
-    m.m[0] = 1.0f - 2.0f * (y * y + z * z);
-    m.m[1] = 2.0f * (x * y + z * w);
-    m.m[2] = 2.0f * (x * z - y * w);
-    m.m[4] = 2.0f * (x * y - z * w);
-    m.m[5] = 1.0f - 2.0f * (x * x + z * z);
-    m.m[6] = 2.0f * (y * z + x * w);
-    m.m[8] = 2.0f * (x * z + y * w);
-    m.m[9] = 2.0f * (y * z - x * w);
-    m.m[10] = 1.0f - 2.0f * (x * x + y * y);
-    return m;
-}
-
-static Float3 SampleTrackVec3(const AnimVec3Track& track, float t, const Float3& fallback) {
-    const size_t count = track.times.size();
-    if (count == 0 || track.values.size() < count * 3)
-        return fallback;
-    if (count == 1 || t <= track.times.front())
-        return Float3{track.values[0], track.values[1], track.values[2]};
-    if (t >= track.times.back()) {
-        const size_t i = (count - 1) * 3;
-        return Float3{track.values[i + 0], track.values[i + 1], track.values[i + 2]};
-    }
-    size_t k = 0;
-    while (k + 1 < count && !(t >= track.times[k] && t <= track.times[k + 1]))
-        ++k;
-    const float t0 = track.times[k];
-    const float t1 = track.times[k + 1];
-    const float a = (t1 > t0) ? ((t - t0) / (t1 - t0)) : 0.0f;
-    const size_t i0 = k * 3;
-    const size_t i1 = (k + 1) * 3;
-    return Float3{
-        track.values[i0 + 0] + (track.values[i1 + 0] - track.values[i0 + 0]) * a,
-        track.values[i0 + 1] + (track.values[i1 + 1] - track.values[i0 + 1]) * a,
-        track.values[i0 + 2] + (track.values[i1 + 2] - track.values[i0 + 2]) * a,
-    };
-}
-
-static Float4 SampleTrackQuat(const AnimQuatTrack& track, float t, const Float4& fallback) {
-    const size_t count = track.times.size();
-    if (count == 0 || track.values.size() < count * 4)
-        return fallback;
-    if (count == 1 || t <= track.times.front())
-        return QuatNormalize(Float4{track.values[0], track.values[1], track.values[2], track.values[3]});
-    if (t >= track.times.back()) {
-        const size_t i = (count - 1) * 4;
-        return QuatNormalize(Float4{track.values[i + 0], track.values[i + 1], track.values[i + 2], track.values[i + 3]});
-    }
-    size_t k = 0;
-    while (k + 1 < count && !(t >= track.times[k] && t <= track.times[k + 1]))
-        ++k;
-    const float t0 = track.times[k];
-    const float t1 = track.times[k + 1];
-    const float a = (t1 > t0) ? ((t - t0) / (t1 - t0)) : 0.0f;
-    const size_t i0 = k * 4;
-    const size_t i1 = (k + 1) * 4;
-    Float4 q0{track.values[i0 + 0], track.values[i0 + 1], track.values[i0 + 2], track.values[i0 + 3]};
-    Float4 q1{track.values[i1 + 0], track.values[i1 + 1], track.values[i1 + 2], track.values[i1 + 3]};
-    float dot = q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w;
-    if (dot < 0.0f) {
-        q1.x = -q1.x;
-        q1.y = -q1.y;
-        q1.z = -q1.z;
-        q1.w = -q1.w;
-    }
-    Float4 q{
-        q0.x + (q1.x - q0.x) * a,
-        q0.y + (q1.y - q0.y) * a,
-        q0.z + (q1.z - q0.z) * a,
-        q0.w + (q1.w - q0.w) * a,
-    };
-    return QuatNormalize(q);
-}
-
-static Mat4f ComposeTRS(const Float3& t, const Float4& r, const Float3& s) {
-    return Mat4Multiply(Mat4Translate(t), Mat4Multiply(Mat4FromQuat(r), Mat4Scale(s)));
-}
-
-static bool ReadAccessorMat4(const tinygltf::Model& model,
-                             const tinygltf::Accessor& accessor,
-                             std::vector<float>* out) {
-    if (!out)
-        return false;
-    out->clear();
-    if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.type != TINYGLTF_TYPE_MAT4)
-        return false;
-    if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size()))
-        return false;
-    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
-    if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size()))
-        return false;
-    const tinygltf::Buffer& buffer = model.buffers[view.buffer];
-    size_t stride = accessor.ByteStride(view);
-    if (stride == 0)
-        stride = sizeof(float) * 16;
-    const size_t base_offset = static_cast<size_t>(view.byteOffset + accessor.byteOffset);
-    const size_t required_bytes = (accessor.count == 0) ? 0 : (stride * (accessor.count - 1) + sizeof(float) * 16);
-    if (base_offset + required_bytes > buffer.data.size())
-        return false;
-    out->resize(accessor.count * 16);
-    const unsigned char* data = buffer.data.data() + base_offset;
-    for (size_t i = 0; i < accessor.count; ++i) {
-        const float* src = reinterpret_cast<const float*>(data + stride * i);
-        for (int k = 0; k < 16; ++k)
-            (*out)[i * 16 + k] = src[k];
-    }
-    return true;
-}
-
 bool LoadGltfAnimationLibrary(const std::string& path,
                               GltfAnimationLibrary* out_library,
                               std::string* error) {
@@ -939,13 +1005,59 @@ bool LoadGltfAnimationLibrary(const std::string& path,
     return true;
 }
 
-bool LoadGltfSkinningFrames(const std::string& model_path,
-                            const std::string& animation_path,
-                            GltfSkinningFrames* out_frames,
-                            std::string* error) {
-    if (!out_frames)
+// Breadth-first order from the roots, so every parent precedes its
+// children. Nodes hanging off a parent cycle (malformed files) never reach
+// a root; the first one found is cut loose as a root instead.
+static void BuildNodeOrder(std::vector<int>* parents, std::vector<int>* order) {
+    const size_t node_count = parents->size();
+    std::vector<int> first_child(node_count, -1);
+    std::vector<int> next_sibling(node_count, -1);
+    for (size_t i = node_count; i-- > 0;) {
+        const int p = (*parents)[i];
+        if (p >= 0) {
+            next_sibling[i] = first_child[p];
+            first_child[p] = static_cast<int>(i);
+        }
+    }
+
+    std::vector<unsigned char> visited(node_count, 0u);
+    order->clear();
+    order->reserve(node_count);
+    for (size_t i = 0; i < node_count; ++i) {
+        if ((*parents)[i] < 0) {
+            visited[i] = 1u;
+            order->push_back(static_cast<int>(i));
+        }
+    }
+    size_t head = 0;
+    size_t orphan_scan = 0;
+    for (;;) {
+        while (head < order->size()) {
+            const int node = (*order)[head++];
+            for (int c = first_child[node]; c >= 0; c = next_sibling[c]) {
+                if (!visited[c]) {
+                    visited[c] = 1u;
+                    order->push_back(c);
+                }
+            }
+        }
+        if (order->size() == node_count)
+            break;
+        while (visited[orphan_scan])
+            ++orphan_scan;
+        (*parents)[orphan_scan] = -1;
+        visited[orphan_scan] = 1u;
+        order->push_back(static_cast<int>(orphan_scan));
+    }
+}
+
+bool LoadGltfSkeleton(const std::string& model_path,
+                      const std::string& animation_path,
+                      GltfSkeleton* out_skeleton,
+                      std::string* error) {
+    if (!out_skeleton)
         return false;
-    *out_frames = GltfSkinningFrames();
+    *out_skeleton = GltfSkeleton();
 
     std::string model_base;
     std::string model_fragment;
@@ -973,45 +1085,61 @@ bool LoadGltfSkinningFrames(const std::string& model_path,
         return false;
     }
 
-    std::vector<Mat4f> inverse_bind;
-    inverse_bind.resize(skin.joints.size(), Mat4Identity());
+    GltfSkeleton& skeleton = *out_skeleton;
+    skeleton.joints = skin.joints;
+    static const float kIdentity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    skeleton.inverse_bind.resize(skin.joints.size() * 16u);
+    for (size_t i = 0; i < skin.joints.size(); ++i)
+        std::memcpy(&skeleton.inverse_bind[i * 16u], kIdentity, sizeof(kIdentity));
     if (skin.inverseBindMatrices >= 0 && skin.inverseBindMatrices < static_cast<int>(model.accessors.size())) {
         std::vector<float> ibm;
-        if (ReadAccessorMat4(model, model.accessors[skin.inverseBindMatrices], &ibm)) {
+        if (ReadAccessor(model, skin.inverseBindMatrices, &ibm, 16)) {
             const size_t count = std::min(skin.joints.size(), ibm.size() / 16);
-            for (size_t i = 0; i < count; ++i)
-                std::memcpy(inverse_bind[i].m, &ibm[i * 16], sizeof(float) * 16);
+            std::memcpy(skeleton.inverse_bind.data(), ibm.data(), sizeof(float) * 16 * count);
         }
     }
 
-    std::vector<int> parents(model.nodes.size(), -1);
-    for (size_t i = 0; i < model.nodes.size(); ++i) {
+    const size_t node_count = model.nodes.size();
+    skeleton.parents.assign(node_count, -1);
+    for (size_t i = 0; i < node_count; ++i) {
         for (size_t c = 0; c < model.nodes[i].children.size(); ++c) {
             int child = model.nodes[i].children[c];
-            if (child >= 0 && child < static_cast<int>(parents.size()))
-                parents[child] = static_cast<int>(i);
+            if (child >= 0 && child < static_cast<int>(node_count))
+                skeleton.parents[child] = static_cast<int>(i);
         }
     }
 
-    std::vector<Float3> default_t(model.nodes.size(), Float3{0.0f, 0.0f, 0.0f});
-    std::vector<Float4> default_r(model.nodes.size(), Float4{0.0f, 0.0f, 0.0f, 1.0f});
-    std::vector<Float3> default_s(model.nodes.size(), Float3{1.0f, 1.0f, 1.0f});
-    std::vector<Mat4f> default_matrix(model.nodes.size(), Mat4Identity());
-    std::vector<bool> has_matrix(model.nodes.size(), false);
-    for (size_t i = 0; i < model.nodes.size(); ++i) {
+    BuildNodeOrder(&skeleton.parents, &skeleton.node_order);
+
+    skeleton.rest_translation.assign(node_count * 3u, 0.0f);
+    skeleton.rest_rotation.assign(node_count * 4u, 0.0f);
+    skeleton.rest_scale.assign(node_count * 3u, 1.0f);
+    skeleton.rest_matrix.resize(node_count * 16u);
+    skeleton.has_matrix.assign(node_count, 0u);
+    for (size_t i = 0; i < node_count; ++i) {
         const tinygltf::Node& n = model.nodes[i];
-        if (n.translation.size() == 3)
-            default_t[i] = Float3{(float)n.translation[0], (float)n.translation[1], (float)n.translation[2]};
-        if (n.rotation.size() == 4)
-            default_r[i] = QuatNormalize(Float4{(float)n.rotation[0], (float)n.rotation[1], (float)n.rotation[2], (float)n.rotation[3]});
-        if (n.scale.size() == 3)
-            default_s[i] = Float3{(float)n.scale[0], (float)n.scale[1], (float)n.scale[2]};
+        float* rt = &skeleton.rest_translation[i * 3u];
+        float* rr = &skeleton.rest_rotation[i * 4u];
+        float* rs = &skeleton.rest_scale[i * 3u];
+        rr[3] = 1.0f;
+        if (n.translation.size() == 3) {
+            for (int k = 0; k < 3; ++k)
+                rt[k] = (float)n.translation[k];
+        }
+        if (n.rotation.size() == 4) {
+            const float r[4] = {(float)n.rotation[0], (float)n.rotation[1], (float)n.rotation[2], (float)n.rotation[3]};
+            voxel::math::QuatNormalize(r, rr);
+        }
+        if (n.scale.size() == 3) {
+            for (int k = 0; k < 3; ++k)
+                rs[k] = (float)n.scale[k];
+        }
         if (n.matrix.size() == 16) {
             for (int k = 0; k < 16; ++k)
-                default_matrix[i].m[k] = (float)n.matrix[k];
-            has_matrix[i] = true;
+                skeleton.rest_matrix[i * 16u + k] = (float)n.matrix[k];
+            skeleton.has_matrix[i] = 1u;
         } else {
-            default_matrix[i] = ComposeTRS(default_t[i], default_r[i], default_s[i]);
+            voxel::math::ComposeTRS(rt, rr, rs, &skeleton.rest_matrix[i * 16u]);
         }
     }
 
@@ -1038,7 +1166,7 @@ bool LoadGltfSkinningFrames(const std::string& model_path,
 
     std::unordered_map<std::string, int> model_node_by_name;
     std::unordered_map<std::string, int> model_node_by_canonical_name;
-    for (size_t i = 0; i < model.nodes.size(); ++i) {
+    for (size_t i = 0; i < node_count; ++i) {
         if (!model.nodes[i].name.empty()) {
             model_node_by_name[model.nodes[i].name] = static_cast<int>(i);
             const std::string canonical = CanonicalNodeName(model.nodes[i].name);
@@ -1047,132 +1175,113 @@ bool LoadGltfSkinningFrames(const std::string& model_path,
         }
     }
 
-    const tinygltf::Animation& anim = anim_model.animations[0];
-    std::vector<NodeAnimTracks> tracks(model.nodes.size());
-    float duration = SampleAnimationDuration(anim_model, anim);
-    int mapped_by_name = 0;
-    int mapped_by_canonical_name = 0;
-    int skipped_unmapped = 0;
-    for (size_t ci = 0; ci < anim.channels.size(); ++ci) {
-        const tinygltf::AnimationChannel& ch = anim.channels[ci];
-        if (ch.sampler < 0 || ch.sampler >= static_cast<int>(anim.samplers.size()))
-            continue;
-        const tinygltf::AnimationSampler& sampler = anim.samplers[ch.sampler];
-        if (sampler.input < 0 || sampler.input >= static_cast<int>(anim_model.accessors.size()) ||
-            sampler.output < 0 || sampler.output >= static_cast<int>(anim_model.accessors.size()))
-            continue;
+    skeleton.clips.resize(anim_model.animations.size());
+    for (size_t ai = 0; ai < anim_model.animations.size(); ++ai) {
+        const tinygltf::Animation& anim = anim_model.animations[ai];
+        GltfSkeletonClip& clip = skeleton.clips[ai];
+        clip.name = anim.name.empty() ? "default" : anim.name;
+        clip.tracks.resize(node_count);
+        float duration = SampleAnimationDuration(anim_model, anim);
+        int mapped_by_name = 0;
+        int mapped_by_canonical_name = 0;
+        int skipped_unmapped = 0;
+        for (size_t ci = 0; ci < anim.channels.size(); ++ci) {
+            const tinygltf::AnimationChannel& ch = anim.channels[ci];
+            if (ch.sampler < 0 || ch.sampler >= static_cast<int>(anim.samplers.size()))
+                continue;
+            const tinygltf::AnimationSampler& sampler = anim.samplers[ch.sampler];
+            if (sampler.input < 0 || sampler.input >= static_cast<int>(anim_model.accessors.size()) ||
+                sampler.output < 0 || sampler.output >= static_cast<int>(anim_model.accessors.size()))
+                continue;
 
-        int model_node = -1;
-        if (&anim_model == &model) {
-            model_node = ch.target_node;
-        } else if (ch.target_node >= 0 && ch.target_node < static_cast<int>(anim_model.nodes.size())) {
-            const std::string& n = anim_model.nodes[ch.target_node].name;
-            auto it = model_node_by_name.find(n);
-            if (it != model_node_by_name.end())
-                model_node = it->second;
-            if (model_node < 0) {
-                const std::string canonical = CanonicalNodeName(n);
-                auto it2 = model_node_by_canonical_name.find(canonical);
-                if (it2 != model_node_by_canonical_name.end()) {
-                    model_node = it2->second;
-                    mapped_by_canonical_name += 1;
+            int model_node = -1;
+            if (&anim_model == &model) {
+                model_node = ch.target_node;
+            } else if (ch.target_node >= 0 && ch.target_node < static_cast<int>(anim_model.nodes.size())) {
+                const std::string& n = anim_model.nodes[ch.target_node].name;
+                auto it = model_node_by_name.find(n);
+                if (it != model_node_by_name.end())
+                    model_node = it->second;
+                if (model_node < 0) {
+                    const std::string canonical = CanonicalNodeName(n);
+                    auto it2 = model_node_by_canonical_name.find(canonical);
+                    if (it2 != model_node_by_canonical_name.end()) {
+                        model_node = it2->second;
+                        mapped_by_canonical_name += 1;
+                    }
                 }
+                if (model_node >= 0)
+                    mapped_by_name += 1;
             }
-            if (model_node >= 0)
-                mapped_by_name += 1;
-        }
-        if (model_node < 0 || model_node >= static_cast<int>(tracks.size())) {
-            skipped_unmapped += 1;
-            continue;
-        }
-
-        std::vector<float> in_times;
-        if (!ReadAccessor(anim_model, anim_model.accessors[sampler.input], &in_times, 1))
-            continue;
-        if (!in_times.empty())
-            duration = std::max(duration, in_times.back());
-
-        if (ch.target_path == "translation") {
-            std::vector<float> out_vals;
-            if (!ReadAccessor(anim_model, anim_model.accessors[sampler.output], &out_vals, 3))
+            if (model_node < 0 || model_node >= static_cast<int>(node_count)) {
+                skipped_unmapped += 1;
                 continue;
-            tracks[model_node].translation.times = in_times;
-            tracks[model_node].translation.values = out_vals;
-        } else if (ch.target_path == "rotation") {
-            std::vector<float> out_vals;
-            if (!ReadAccessor(anim_model, anim_model.accessors[sampler.output], &out_vals, 4))
+            }
+
+            std::vector<float> in_times;
+            if (!ReadAccessor(anim_model, sampler.input, &in_times, 1))
                 continue;
-            tracks[model_node].rotation.times = in_times;
-            tracks[model_node].rotation.values = out_vals;
-        } else if (ch.target_path == "scale") {
+            if (!in_times.empty())
+                duration = std::max(duration, in_times.back());
+
+            GltfNodeTracks& tracks = clip.tracks[model_node];
+            GltfAnimationTrack* track = nullptr;
+            int components = 3;
+            if (ch.target_path == "translation") {
+                track = &tracks.translation;
+            } else if (ch.target_path == "rotation") {
+                track = &tracks.rotation;
+                components = 4;
+            } else if (ch.target_path == "scale") {
+                track = &tracks.scale;
+            }
             std::vector<float> out_vals;
-            if (!ReadAccessor(anim_model, anim_model.accessors[sampler.output], &out_vals, 3))
+            if (!track || !ReadAccessor(anim_model, sampler.output, &out_vals, components))
                 continue;
-            tracks[model_node].scale.times = in_times;
-            tracks[model_node].scale.values = out_vals;
+            const size_t key_count = std::min(in_times.size(), out_vals.size() / components);
+            CompressGltfAnimationTrack(in_times.data(), out_vals.data(), key_count, components, track);
+        }
+        clip.duration = duration;
+
+        if (&anim_model != &model && skipped_unmapped > 0) {
+            std::fprintf(stderr,
+                         "Animation remap '%s': skipped %d channels with no node-name match (mapped_by_name=%d canonical=%d)\n",
+                         clip.name.c_str(),
+                         skipped_unmapped,
+                         mapped_by_name,
+                         mapped_by_canonical_name);
         }
     }
 
-    if (&anim_model != &model && skipped_unmapped > 0) {
-        std::fprintf(stderr,
-                     "Animation remap: skipped %d channels with no node-name match (mapped_by_name=%d canonical=%d)\n",
-                     skipped_unmapped,
-                     mapped_by_name,
-                     mapped_by_canonical_name);
-    }
-
-    const float sample_fps = 30.0f;
-    uint32_t frame_count = 1;
-    if (duration > 0.0001f)
-        frame_count = std::max<uint32_t>(2u, static_cast<uint32_t>(std::ceil(duration * sample_fps)) + 1u);
-
-    out_frames->joint_count = static_cast<uint32_t>(skin.joints.size());
-    out_frames->frame_count = frame_count;
-    out_frames->duration = duration;
-    out_frames->palettes.resize(static_cast<size_t>(frame_count) * skin.joints.size() * 16u, 0.0f);
+    return true;
+}
 
-    std::vector<Mat4f> local(model.nodes.size(), Mat4Identity());
-    std::vector<Mat4f> global(model.nodes.size(), Mat4Identity());
-    for (uint32_t fi = 0; fi < frame_count; ++fi) {
-        const float t = (frame_count > 1) ? (duration * (float(fi) / float(frame_count - 1))) : 0.0f;
+bool LoadGltfSkinningFrames(const std::string& model_path,
+                            const std::string& animation_path,
+                            GltfSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers) {
+    if (!out_frames)
+        return false;
+    *out_frames = GltfSkinningFrames();
 
-        for (size_t ni = 0; ni < model.nodes.size(); ++ni) {
-            if (has_matrix[ni]) {
-                local[ni] = default_matrix[ni];
-                continue;
-            }
-            const NodeAnimTracks& tr = tracks[ni];
-            const Float3 tt = SampleTrackVec3(tr.translation, t, default_t[ni]);
-            const Float4 rr = SampleTrackQuat(tr.rotation, t, default_r[ni]);
-            const Float3 ss = SampleTrackVec3(tr.scale, t, default_s[ni]);
-            local[ni] = ComposeTRS(tt, rr, ss);
-        }
+    GltfSkeleton skeleton;
+    if (!LoadGltfSkeleton(model_path, animation_path, &skeleton, error))
+        return false;
+    return BakeGltfSkinningFrames(skeleton, out_frames, error, workers);
+}
 
-        std::vector<uint8_t> global_ready(model.nodes.size(), 0u);
-        std::function<void(size_t)> compute_global = [&](size_t ni) {
-            if (global_ready[ni])
-                return;
-            const int p = parents[ni];
-            if (p >= 0) {
-                compute_global(static_cast<size_t>(p));
-                global[ni] = Mat4Multiply(global[static_cast<size_t>(p)], local[ni]);
-            } else {
-                global[ni] = local[ni];
-            }
-            global_ready[ni] = 1u;
-        };
-        for (size_t ni = 0; ni < model.nodes.size(); ++ni)
-            compute_global(ni);
-
-        for (size_t ji = 0; ji < skin.joints.size(); ++ji) {
-            const int node_index = skin.joints[ji];
-            Mat4f joint_mat = Mat4Identity();
-            if (node_index >= 0 && node_index < static_cast<int>(global.size()))
-                joint_mat = Mat4Multiply(global[(size_t)node_index], inverse_bind[ji]);
-            const size_t dst = (static_cast<size_t>(fi) * skin.joints.size() + ji) * 16u;
-            std::memcpy(&out_frames->palettes[dst], joint_mat.m, sizeof(float) * 16);
-        }
-    }
+bool LoadGltfSkinningFrames(const std::string& model_path,
+                            const std::string& animation_path,
+                            GltfPackedSkinningFrames* out_frames,
+                            std::string* error,
+                            voxel::VoxelWorkerPool* workers) {
+    if (!out_frames)
+        return false;
+    *out_frames = GltfPackedSkinningFrames();
 
-    return true;
-}
\ No newline at end of file
+    GltfSkeleton skeleton;
+    if (!LoadGltfSkeleton(model_path, animation_path, &skeleton, error))
+        return false;
+    return BakeGltfSkinningFrames(skeleton, out_frames, error, workers);
+}
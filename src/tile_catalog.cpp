@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <chrono>
 #include <cstdint>
+#include <utility>
 
 #if defined(_WIN32)
 #include <direct.h>
@@ -220,10 +221,10 @@ static bool LoadMeshCache(const std::string& repo_root,
             std::fprintf(stderr, "Mesh cache invalid header: %s\n", cache_path.c_str());
         return false;
     }
-    if (magic != 0x4853454D || version != 4) {
+    if (magic != 0x4853454D || version != 5) {
         if (MeshCacheDebugEnabled()) {
             std::fprintf(stderr,
-                         "Mesh cache stale/unsupported version (got=%u, want=4): %s\n",
+                         "Mesh cache stale/unsupported version (got=%u, want=5): %s\n",
                          version,
                          cache_path.c_str());
         }
@@ -255,6 +256,8 @@ static bool LoadMeshCache(const std::string& repo_root,
     } else {
         out_mesh->base_color_texture_path.clear();
     }
+    if (!ReadU32Vec(in, &out_mesh->mesh.indices))
+        return false;
     out_mesh->has_uv = (has_uv != 0);
     if (MeshCacheDebugEnabled())
         std::fprintf(stderr, "Mesh cache hit: %s\n", cache_path.c_str());
@@ -278,7 +281,7 @@ static void SaveMeshCache(const std::string& repo_root,
         return;
     }
     WriteU32(out, 0x4853454D); // MESH
-    WriteU32(out, 4);
+    WriteU32(out, 5);
     WriteU32(out, mesh.has_uv ? 1u : 0u);
     WriteF32Vec(out, mesh.mesh.positions);
     WriteF32Vec(out, mesh.mesh.normals);
@@ -287,6 +290,7 @@ static void SaveMeshCache(const std::string& repo_root,
     WriteU32Vec(out, mesh.mesh.joints);
     WriteF32Vec(out, mesh.mesh.weights);
     WriteString(out, mesh.base_color_texture_path);
+    WriteU32Vec(out, mesh.mesh.indices);
     if (MeshCacheDebugEnabled())
         std::fprintf(stderr, "Mesh cache write: %s\n", cache_path.c_str());
 }
@@ -580,7 +584,13 @@ bool PopulateTileResources(const std::string& repo_root,
 
     const bool timing_enabled = MeshLoadTimingEnabled();
     auto mesh_start = std::chrono::steady_clock::now();
-    std::map<std::string, GltfMesh> mesh_cache;
+    // Models already loaded for an earlier tile: index into `meshes` plus the
+    // glTF metadata that is not part of MeshData.
+    struct LoadedModel {
+        size_t mesh_index;
+        std::string base_color_texture_path;
+    };
+    std::map<std::string, LoadedModel> loaded_models;
     for (size_t i = 0; i < tiles->size(); ++i) {
         std::string animation_path = StripResPrefix((*tiles)[i].animation);
         if (!animation_path.empty())
@@ -599,9 +609,11 @@ bool PopulateTileResources(const std::string& repo_root,
         std::string mesh_error;
         bool loaded_from_cache = false;
         bool mesh_ok = false;
-        std::map<std::string, GltfMesh>::const_iterator it = mesh_cache.find(model_path);
-        if (it != mesh_cache.end()) {
-            mesh = it->second;
+        std::map<std::string, LoadedModel>::const_iterator it = loaded_models.find(model_path);
+        if (it != loaded_models.end()) {
+            mesh.mesh = meshes[it->second.mesh_index];
+            mesh.has_uv = mesh_has_uv[it->second.mesh_index];
+            mesh.base_color_texture_path = it->second.base_color_texture_path;
             mesh_ok = true;
             loaded_from_cache = true;
         } else {
@@ -618,7 +630,7 @@ bool PopulateTileResources(const std::string& repo_root,
                 GltfMesh refreshed_mesh;
                 std::string reload_error;
                 if (LoadGltfMesh(model_path, &refreshed_mesh, &reload_error)) {
-                    mesh = refreshed_mesh;
+                    mesh = std::move(refreshed_mesh);
                     loaded_from_cache = false;
                     mesh_ok = true;
                     std::fprintf(stderr,
@@ -647,11 +659,15 @@ bool PopulateTileResources(const std::string& repo_root,
             mesh.mesh.is_skinned = ((*tiles)[i].material == "skinned");
             mesh.mesh.source_model_path = model_path;
             mesh.mesh.source_animation_path = animation_path;
-            meshes.push_back(mesh.mesh);
-            mesh_has_uv.push_back(mesh.has_uv);
             if (!loaded_from_cache && mesh_error.empty())
                 SaveMeshCache(repo_root, model_path, mesh);
-            mesh_cache[model_path] = mesh;
+            if (it == loaded_models.end()) {
+                LoadedModel& loaded = loaded_models[model_path];
+                loaded.mesh_index = meshes.size();
+                loaded.base_color_texture_path = mesh.base_color_texture_path;
+            }
+            meshes.push_back(std::move(mesh.mesh));
+            mesh_has_uv.push_back(mesh.has_uv);
         } else {
             if (!mesh_error.empty())
                 std::fprintf(stderr, "Failed to load model %s: %s\n", model_path.c_str(), mesh_error.c_str());
@@ -683,7 +699,7 @@ bool PopulateTileResources(const std::string& repo_root,
         }
         if (i < meshes.size())
             meshes[i].source_animation_path = animation_path;
-        animations.push_back(library);
+        animations.push_back(std::move(library));
         (*tiles)[i].animation = animation_path;
     }
     if (timing_enabled) {
@@ -725,14 +741,14 @@ bool PopulateTileResources(const std::string& repo_root,
         index_by_key[(*tiles)[i].key] = static_cast<int>(i);
 
     out_catalog->tiles = *tiles;
-    out_catalog->meshes = meshes;
-    out_catalog->mesh_has_uv = mesh_has_uv;
-    out_catalog->texture_paths = textures;
+    out_catalog->meshes.swap(meshes);
+    out_catalog->mesh_has_uv.swap(mesh_has_uv);
+    out_catalog->texture_paths.swap(textures);
     out_catalog->animation_paths.reserve(tiles->size());
     for (size_t i = 0; i < tiles->size(); ++i)
         out_catalog->animation_paths.push_back((*tiles)[i].animation);
-    out_catalog->animation_libraries = animations;
-    out_catalog->index_by_key = index_by_key;
+    out_catalog->animation_libraries.swap(animations);
+    out_catalog->index_by_key.swap(index_by_key);
     return true;
 }
 
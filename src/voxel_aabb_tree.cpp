@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voxel_aabb_tree.h"
+
+#include <algorithm>
+
+namespace voxel {
+
+static VoxelAabb UnionAabb(const VoxelAabb& a, const VoxelAabb& b) {
+    VoxelAabb r;
+    for (int axis = 0; axis < 3; ++axis) {
+        r.min[axis] = std::min(a.min[axis], b.min[axis]);
+        r.max[axis] = std::max(a.max[axis], b.max[axis]);
+    }
+    return r;
+}
+
+static float SurfaceArea(const VoxelAabb& box) {
+    const float dx = box.max[0] - box.min[0];
+    const float dy = box.max[1] - box.min[1];
+    const float dz = box.max[2] - box.min[2];
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+VoxelFrustum VoxelFrustum::fromMatrix(const float m[16]) {
+    return fromMatrixRect(m, -1.0f, -1.0f, 1.0f, 1.0f);
+}
+
+VoxelFrustum VoxelFrustum::fromMatrixRect(const float m[16], float min_x, float min_y, float max_x, float max_y) {
+    VoxelFrustum f;
+    for (int c = 0; c < 4; ++c) {
+        const float row0 = m[c * 4 + 0];
+        const float row1 = m[c * 4 + 1];
+        const float row2 = m[c * 4 + 2];
+        const float row3 = m[c * 4 + 3];
+        f.planes[0][c] = row0 - min_x * row3;
+        f.planes[1][c] = max_x * row3 - row0;
+        f.planes[2][c] = row1 - min_y * row3;
+        f.planes[3][c] = max_y * row3 - row1;
+        f.planes[4][c] = row2;
+        f.planes[5][c] = row3 - row2;
+    }
+    return f;
+}
+
+bool VoxelFrustum::intersects(const VoxelAabb& box) const {
+    for (int p = 0; p < 6; ++p) {
+        const float* plane = planes[p];
+        const float x = (plane[0] >= 0.0f) ? box.max[0] : box.min[0];
+        const float y = (plane[1] >= 0.0f) ? box.max[1] : box.min[1];
+        const float z = (plane[2] >= 0.0f) ? box.max[2] : box.min[2];
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+VoxelAabbTree::VoxelAabbTree()
+    : root_(kNullNode)
+    , free_list_(kNullNode)
+    , leaf_count_(0) {
+}
+
+void VoxelAabbTree::clear() {
+    nodes_.clear();
+    root_ = kNullNode;
+    free_list_ = kNullNode;
+    leaf_count_ = 0;
+}
+
+int VoxelAabbTree::allocateNode() {
+    if (free_list_ == kNullNode) {
+        nodes_.push_back(Node());
+        return static_cast<int>(nodes_.size() - 1);
+    }
+    const int node = free_list_;
+    free_list_ = nodes_[node].parent;
+    nodes_[node] = Node();
+    return node;
+}
+
+void VoxelAabbTree::freeNode(int node) {
+    nodes_[node].parent = free_list_;
+    nodes_[node].height = -1;
+    free_list_ = node;
+}
+
+int VoxelAabbTree::insert(const VoxelAabb& box, uint32_t user_data) {
+    const int leaf = allocateNode();
+    nodes_[leaf].box = box;
+    nodes_[leaf].user_data = user_data;
+    insertLeaf(leaf);
+    leaf_count_ += 1;
+    return leaf;
+}
+
+void VoxelAabbTree::remove(int proxy) {
+    if (proxy < 0 || static_cast<size_t>(proxy) >= nodes_.size() || !nodes_[proxy].isLeaf() || nodes_[proxy].height < 0)
+        return;
+    removeLeaf(proxy);
+    freeNode(proxy);
+    leaf_count_ -= 1;
+}
+
+void VoxelAabbTree::update(int proxy, const VoxelAabb& box) {
+    if (proxy < 0 || static_cast<size_t>(proxy) >= nodes_.size() || nodes_[proxy].height < 0)
+        return;
+    removeLeaf(proxy);
+    nodes_[proxy].box = box;
+    insertLeaf(proxy);
+}
+
+void VoxelAabbTree::setUserData(int proxy, uint32_t user_data) {
+    if (proxy >= 0 && static_cast<size_t>(proxy) < nodes_.size())
+        nodes_[proxy].user_data = user_data;
+}
+
+uint32_t VoxelAabbTree::userData(int proxy) const {
+    return nodes_[proxy].user_data;
+}
+
+size_t VoxelAabbTree::size() const {
+    return leaf_count_;
+}
+
+void VoxelAabbTree::insertLeaf(int leaf) {
+    if (root_ == kNullNode) {
+        root_ = leaf;
+        nodes_[leaf].parent = kNullNode;
+        return;
+    }
+
+    // Walk down towards the sibling with the lowest surface area increase.
+    const VoxelAabb leaf_box = nodes_[leaf].box;
+    int index = root_;
+    while (!nodes_[index].isLeaf()) {
+        const Node& node = nodes_[index];
+        const float area = SurfaceArea(node.box);
+        const float combined_area = SurfaceArea(UnionAabb(node.box, leaf_box));
+        const float cost = 2.0f * combined_area;
+        const float inheritance_cost = 2.0f * (combined_area - area);
+
+        float child_cost[2];
+        for (int c = 0; c < 2; ++c) {
+            const Node& child = nodes_[node.child[c]];
+            const float merged = SurfaceArea(UnionAabb(leaf_box, child.box));
+            child_cost[c] = (child.isLeaf() ? merged : merged - SurfaceArea(child.box)) + inheritance_cost;
+        }
+        if (cost < child_cost[0] && cost < child_cost[1])
+            break;
+        index = (child_cost[0] < child_cost[1]) ? node.child[0] : node.child[1];
+    }
+
+    const int sibling = index;
+    const int new_parent = allocateNode();
+    const int old_parent = nodes_[sibling].parent;
+    nodes_[new_parent].parent = old_parent;
+    nodes_[new_parent].box = UnionAabb(leaf_box, nodes_[sibling].box);
+    nodes_[new_parent].height = nodes_[sibling].height + 1;
+    nodes_[new_parent].child[0] = sibling;
+    nodes_[new_parent].child[1] = leaf;
+    nodes_[sibling].parent = new_parent;
+    nodes_[leaf].parent = new_parent;
+    if (old_parent != kNullNode) {
+        Node& parent = nodes_[old_parent];
+        parent.child[parent.child[0] == sibling ? 0 : 1] = new_parent;
+    } else {
+        root_ = new_parent;
+    }
+
+    for (index = nodes_[leaf].parent; index != kNullNode; index = nodes_[index].parent) {
+        index = balance(index);
+        refit(index);
+    }
+}
+
+void VoxelAabbTree::removeLeaf(int leaf) {
+    if (leaf == root_) {
+        root_ = kNullNode;
+        return;
+    }
+    const int parent = nodes_[leaf].parent;
+    const int grand_parent = nodes_[parent].parent;
+    const int sibling = (nodes_[parent].child[0] == leaf) ? nodes_[parent].child[1] : nodes_[parent].child[0];
+
+    if (grand_parent == kNullNode) {
+        root_ = sibling;
+        nodes_[sibling].parent = kNullNode;
+        freeNode(parent);
+        return;
+    }
+    Node& grand = nodes_[grand_parent];
+    grand.child[grand.child[0] == parent ? 0 : 1] = sibling;
+    nodes_[sibling].parent = grand_parent;
+    freeNode(parent);
+    for (int index = grand_parent; index != kNullNode; index = nodes_[index].parent) {
+        index = balance(index);
+        refit(index);
+    }
+}
+
+void VoxelAabbTree::refit(int node) {
+    Node& n = nodes_[node];
+    const Node& a = nodes_[n.child[0]];
+    const Node& b = nodes_[n.child[1]];
+    n.box = UnionAabb(a.box, b.box);
+    n.height = 1 + std::max(a.height, b.height);
+}
+
+// Tree rotation: promotes the taller grandchild when the subtree heights
+// differ by more than one. Returns the new root of the subtree.
+int VoxelAabbTree::balance(int ia) {
+    Node& a = nodes_[ia];
+    if (a.isLeaf() || a.height < 2)
+        return ia;
+
+    const int diff = nodes_[a.child[1]].height - nodes_[a.child[0]].height;
+    if (diff >= -1 && diff <= 1)
+        return ia;
+
+    // `up` is the taller child that replaces `a`; `keep` stays under `a`.
+    const int up_side = (diff > 1) ? 1 : 0;
+    const int iup = a.child[up_side];
+    Node& up = nodes_[iup];
+    const int i_left = up.child[0];
+    const int i_right = up.child[1];
+
+    up.child[0] = ia;
+    up.parent = a.parent;
+    a.parent = iup;
+    if (up.parent != kNullNode) {
+        Node& parent = nodes_[up.parent];
+        parent.child[parent.child[0] == ia ? 0 : 1] = iup;
+    } else {
+        root_ = iup;
+    }
+
+    // The taller grandchild stays with `up`, the other one moves under `a`.
+    const bool left_taller = nodes_[i_left].height > nodes_[i_right].height;
+    const int i_stay = left_taller ? i_left : i_right;
+    const int i_move = left_taller ? i_right : i_left;
+    up.child[1] = i_stay;
+    a.child[up_side] = i_move;
+    nodes_[i_move].parent = ia;
+    refit(ia);
+    refit(iup);
+    return iup;
+}
+
+void VoxelAabbTree::queryFrustum(const VoxelFrustum& frustum, std::vector<uint32_t>* out) const {
+    if (!out || root_ == kNullNode)
+        return;
+    // Each stack entry carries the planes its parent was not yet fully inside
+    // of, so subtrees completely inside the frustum skip the plane tests.
+    struct Entry {
+        int node;
+        unsigned int plane_mask;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    Entry root_entry = {root_, 0x3Fu};
+    stack.push_back(root_entry);
+    while (!stack.empty()) {
+        const Entry entry = stack.back();
+        stack.pop_back();
+        const Node& node = nodes_[entry.node];
+        unsigned int mask = entry.plane_mask;
+        bool outside = false;
+        for (int p = 0; p < 6 && mask != 0; ++p) {
+            if (!(mask & (1u << p)))
+                continue;
+            const float* plane = frustum.planes[p];
+            const float px = (plane[0] >= 0.0f) ? node.box.max[0] : node.box.min[0];
+            const float py = (plane[1] >= 0.0f) ? node.box.max[1] : node.box.min[1];
+            const float pz = (plane[2] >= 0.0f) ? node.box.max[2] : node.box.min[2];
+            if (plane[0] * px + plane[1] * py + plane[2] * pz + plane[3] < 0.0f) {
+                outside = true;
+                break;
+            }
+            const float nx = (plane[0] >= 0.0f) ? node.box.min[0] : node.box.max[0];
+            const float ny = (plane[1] >= 0.0f) ? node.box.min[1] : node.box.max[1];
+            const float nz = (plane[2] >= 0.0f) ? node.box.min[2] : node.box.max[2];
+            if (plane[0] * nx + plane[1] * ny + plane[2] * nz + plane[3] >= 0.0f)
+                mask &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+        if (node.isLeaf()) {
+            out->push_back(node.user_data);
+            continue;
+        }
+        Entry left = {node.child[0], mask};
+        Entry right = {node.child[1], mask};
+        stack.push_back(left);
+        stack.push_back(right);
+    }
+}
+
+} // namespace voxel
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voxel_chunk_grid.h"
+
+#include <cmath>
+#include <limits>
+
+namespace voxel {
+
+static const int kEmptyCell = std::numeric_limits<int>::min();
+static const float kCellAlignEpsilon = 0.001f;
+
+VoxelChunkGrid::VoxelChunkGrid()
+    : cell_size_(1.0f)
+    , has_origin_(false) {
+    origin_[0] = 0.0f;
+    origin_[1] = 0.0f;
+    origin_[2] = 0.0f;
+}
+
+void VoxelChunkGrid::reset(float cell_size) {
+    for (std::map<ChunkKey, Chunk>::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
+        dirty_.insert(it->first);
+    chunks_.clear();
+    cell_size_ = (cell_size > 0.0f) ? cell_size : 1.0f;
+    has_origin_ = false;
+}
+
+float VoxelChunkGrid::cellSize() const {
+    return cell_size_;
+}
+
+bool VoxelChunkGrid::cellForPosition(float x, float y, float z, int* out_x, int* out_y, int* out_z) {
+    if (!has_origin_ && chunks_.empty()) {
+        origin_[0] = x;
+        origin_[1] = y;
+        origin_[2] = z;
+        has_origin_ = true;
+    }
+    const float p[3] = {x, y, z};
+    int cell[3] = {0, 0, 0};
+    for (int axis = 0; axis < 3; ++axis) {
+        const float f = (p[axis] - origin_[axis]) / cell_size_;
+        const float r = std::floor(f + 0.5f);
+        if (std::fabs(f - r) > kCellAlignEpsilon)
+            return false;
+        cell[axis] = static_cast<int>(r);
+    }
+    *out_x = cell[0];
+    *out_y = cell[1];
+    *out_z = cell[2];
+    return true;
+}
+
+int VoxelChunkGrid::floorDiv(int value, int divisor) {
+    int q = value / divisor;
+    if ((value % divisor) != 0 && ((value < 0) != (divisor < 0)))
+        --q;
+    return q;
+}
+
+ChunkKey VoxelChunkGrid::keyForCell(int x, int y, int z) {
+    ChunkKey key = {floorDiv(x, kChunkSize), floorDiv(y, kChunkSize), floorDiv(z, kChunkSize)};
+    return key;
+}
+
+int VoxelChunkGrid::cellIndex(int lx, int ly, int lz) {
+    return (lz * kChunkSize + ly) * kChunkSize + lx;
+}
+
+int VoxelChunkGrid::cellAt(int x, int y, int z) const {
+    const ChunkKey key = keyForCell(x, y, z);
+    std::map<ChunkKey, Chunk>::const_iterator it = chunks_.find(key);
+    if (it == chunks_.end())
+        return kEmptyCell;
+    return it->second.cells[cellIndex(x - key.x * kChunkSize, y - key.y * kChunkSize, z - key.z * kChunkSize)];
+}
+
+void VoxelChunkGrid::markDirty(int x, int y, int z) {
+    const ChunkKey key = keyForCell(x, y, z);
+    dirty_.insert(key);
+    const int local[3] = {x - key.x * kChunkSize, y - key.y * kChunkSize, z - key.z * kChunkSize};
+    for (int axis = 0; axis < 3; ++axis) {
+        // Border cells change the hidden faces of the adjacent chunk too.
+        if (local[axis] == 0 || local[axis] == kChunkSize - 1) {
+            ChunkKey neighbour = key;
+            int* component = (axis == 0) ? &neighbour.x : (axis == 1) ? &neighbour.y : &neighbour.z;
+            *component += (local[axis] == 0) ? -1 : 1;
+            if (chunks_.find(neighbour) != chunks_.end())
+                dirty_.insert(neighbour);
+        }
+    }
+}
+
+bool VoxelChunkGrid::insertCell(int x, int y, int z, int tex_index) {
+    if (tex_index == kEmptyCell)
+        return false;
+    const ChunkKey key = keyForCell(x, y, z);
+    Chunk& chunk = chunks_[key];
+    if (chunk.cells.empty())
+        chunk.cells.assign(kChunkSize * kChunkSize * kChunkSize, kEmptyCell);
+    int& cell = chunk.cells[cellIndex(x - key.x * kChunkSize, y - key.y * kChunkSize, z - key.z * kChunkSize)];
+    if (cell != kEmptyCell)
+        return false;
+    cell = tex_index;
+    chunk.solid_count += 1;
+    markDirty(x, y, z);
+    return true;
+}
+
+bool VoxelChunkGrid::removeCell(int x, int y, int z) {
+    const ChunkKey key = keyForCell(x, y, z);
+    std::map<ChunkKey, Chunk>::iterator it = chunks_.find(key);
+    if (it == chunks_.end())
+        return false;
+    int& cell = it->second.cells[cellIndex(x - key.x * kChunkSize, y - key.y * kChunkSize, z - key.z * kChunkSize)];
+    if (cell == kEmptyCell)
+        return false;
+    cell = kEmptyCell;
+    it->second.solid_count -= 1;
+    markDirty(x, y, z);
+    if (it->second.solid_count <= 0)
+        chunks_.erase(it);
+    return true;
+}
+
+bool VoxelChunkGrid::hasCell(int x, int y, int z) const {
+    return cellAt(x, y, z) != kEmptyCell;
+}
+
+const std::set<ChunkKey>& VoxelChunkGrid::dirtyChunks() const {
+    return dirty_;
+}
+
+void VoxelChunkGrid::clearDirty() {
+    dirty_.clear();
+}
+
+bool VoxelChunkGrid::hasChunk(const ChunkKey& key) const {
+    return chunks_.find(key) != chunks_.end();
+}
+
+void VoxelChunkGrid::chunkBounds(const ChunkKey& key, float out_min[3], float out_max[3]) const {
+    const int base[3] = {key.x * kChunkSize, key.y * kChunkSize, key.z * kChunkSize};
+    for (int axis = 0; axis < 3; ++axis) {
+        out_min[axis] = origin_[axis] + (static_cast<float>(base[axis]) - 0.5f) * cell_size_;
+        out_max[axis] = out_min[axis] + static_cast<float>(kChunkSize) * cell_size_;
+    }
+}
+
+void VoxelChunkGrid::buildChunkMesh(const ChunkKey& key, std::vector<Section>* out_sections) const {
+    if (!out_sections)
+        return;
+    out_sections->clear();
+    std::map<ChunkKey, Chunk>::const_iterator chunk_it = chunks_.find(key);
+    if (chunk_it == chunks_.end())
+        return;
+    const std::vector<int>& cells = chunk_it->second.cells;
+    const int n = kChunkSize;
+    const int base[3] = {key.x * n, key.y * n, key.z * n};
+    std::map<int, size_t> section_by_tex;
+    std::vector<int> mask(n * n, kEmptyCell);
+
+    for (int d = 0; d < 3; ++d) {
+        const int u = (d + 1) % 3;
+        const int v = (d + 2) % 3;
+        for (int side = 0; side < 2; ++side) {
+            const int dir = side ? 1 : -1;
+            for (int slice = 0; slice < n; ++slice) {
+                for (int j = 0; j < n; ++j) {
+                    for (int i = 0; i < n; ++i) {
+                        int local[3];
+                        local[d] = slice;
+                        local[u] = i;
+                        local[v] = j;
+                        const int tex = cells[cellIndex(local[0], local[1], local[2])];
+                        int face = kEmptyCell;
+                        if (tex != kEmptyCell) {
+                            int neighbour[3] = {local[0], local[1], local[2]};
+                            neighbour[d] += dir;
+                            int other = kEmptyCell;
+                            if (neighbour[d] >= 0 && neighbour[d] < n)
+                                other = cells[cellIndex(neighbour[0], neighbour[1], neighbour[2])];
+                            else
+                                other = cellAt(base[0] + neighbour[0], base[1] + neighbour[1], base[2] + neighbour[2]);
+                            if (other == kEmptyCell)
+                                face = tex;
+                        }
+                        mask[j * n + i] = face;
+                    }
+                }
+
+                for (int j = 0; j < n; ++j) {
+                    for (int i = 0; i < n;) {
+                        const int tex = mask[j * n + i];
+                        if (tex == kEmptyCell) {
+                            ++i;
+                            continue;
+                        }
+                        int w = 1;
+                        while (i + w < n && mask[j * n + i + w] == tex)
+                            ++w;
+                        int h = 1;
+                        for (; j + h < n; ++h) {
+                            bool row_matches = true;
+                            for (int k = 0; k < w; ++k) {
+                                if (mask[(j + h) * n + i + k] != tex) {
+                                    row_matches = false;
+                                    break;
+                                }
+                            }
+                            if (!row_matches)
+                                break;
+                        }
+                        for (int dj = 0; dj < h; ++dj) {
+                            for (int di = 0; di < w; ++di)
+                                mask[(j + dj) * n + i + di] = kEmptyCell;
+                        }
+
+                        std::map<int, size_t>::iterator sec_it = section_by_tex.find(tex);
+                        if (sec_it == section_by_tex.end()) {
+                            sec_it = section_by_tex.insert(std::make_pair(tex, out_sections->size())).first;
+                            out_sections->push_back(Section());
+                            out_sections->back().tex_index = tex;
+                        }
+                        Section& section = (*out_sections)[sec_it->second];
+
+                        // Corners in chunk-local cell-edge units (0..kChunkSize).
+                        const float plane = static_cast<float>(slice) + (dir > 0 ? 1.0f : 0.0f);
+                        const float u0 = static_cast<float>(i);
+                        const float u1 = static_cast<float>(i + w);
+                        const float v0 = static_cast<float>(j);
+                        const float v1 = static_cast<float>(j + h);
+                        const float corner_uv[4][2] = {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+                        // e_u x e_v == +e_d, while the renderer's front faces have
+                        // cross(b - a, c - a) pointing against the normal.
+                        static const int kOrderNeg[6] = {0, 1, 2, 0, 2, 3};
+                        static const int kOrderPos[6] = {0, 2, 1, 0, 3, 2};
+                        const int* order = (dir > 0) ? kOrderPos : kOrderNeg;
+                        for (int c = 0; c < 6; ++c) {
+                            const float* cuv = corner_uv[order[c]];
+                            float edge[3];
+                            edge[d] = plane;
+                            edge[u] = cuv[0];
+                            edge[v] = cuv[1];
+                            for (int axis = 0; axis < 3; ++axis) {
+                                const float cell = static_cast<float>(base[axis]) + edge[axis] - 0.5f;
+                                section.positions.push_back(origin_[axis] + cell * cell_size_);
+                            }
+                            float normal[3] = {0.0f, 0.0f, 0.0f};
+                            normal[d] = static_cast<float>(dir);
+                            section.normals.push_back(normal[0]);
+                            section.normals.push_back(normal[1]);
+                            section.normals.push_back(normal[2]);
+                            // Same texture orientation as the single-cube faces.
+                            if (d == 2) {
+                                section.uvs.push_back(edge[0]);
+                                section.uvs.push_back(edge[1]);
+                            } else if (d == 1) {
+                                section.uvs.push_back(edge[0]);
+                                section.uvs.push_back(-edge[2]);
+                            } else {
+                                section.uvs.push_back(-edge[2]);
+                                section.uvs.push_back(edge[1]);
+                            }
+                        }
+                        i += w;
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace voxel
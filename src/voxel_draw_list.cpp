@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voxel_draw_list.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace voxel {
+
+static const uint32_t kNoRank = 0xFFFFFFFFu;
+static const size_t kMinInsertionMoves = 64;
+
+// Non-negative IEEE floats order the same way as their bit patterns.
+static uint32_t DepthBits(float dist2) {
+    if (!(dist2 > 0.0f))
+        return 0;
+    uint32_t bits = 0;
+    std::memcpy(&bits, &dist2, sizeof(bits));
+    return bits;
+}
+
+uint64_t VoxelDrawList::opaqueKey(uint32_t pipeline, uint32_t mesh, uint32_t texture, float dist2) {
+    const uint64_t p = std::min<uint32_t>(pipeline, 0xFu);
+    const uint64_t m = std::min<uint32_t>(mesh, 0xFFFFu);
+    const uint64_t t = std::min<uint32_t>(texture, 0xFFFu);
+    return (p << 60) | (m << 44) | (t << 32) | DepthBits(dist2);
+}
+
+uint64_t VoxelDrawList::backToFrontKey(float dist2) {
+    return 0xFFFFFFFFu - DepthBits(dist2);
+}
+
+void VoxelDrawList::clear() {
+    items_.clear();
+}
+
+void VoxelDrawList::add(uint64_t key, uint32_t id) {
+    Item item = {key, id};
+    items_.push_back(item);
+}
+
+void VoxelDrawList::sort() {
+    const size_t n = items_.size();
+
+    // Lay the items out in last frame's order; new ids go to the end.
+    slots_.assign(prev_ids_.size(), kNoRank);
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t id = items_[i].id;
+        const uint32_t rank = (id < prev_rank_.size()) ? prev_rank_[id] : kNoRank;
+        if (rank != kNoRank && slots_[rank] == kNoRank)
+            slots_[rank] = static_cast<uint32_t>(i);
+    }
+    scratch_.clear();
+    scratch_.reserve(n);
+    for (size_t r = 0; r < slots_.size(); ++r) {
+        if (slots_[r] != kNoRank)
+            scratch_.push_back(items_[slots_[r]]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t id = items_[i].id;
+        const uint32_t rank = (id < prev_rank_.size()) ? prev_rank_[id] : kNoRank;
+        if (rank == kNoRank || slots_[rank] != i)
+            scratch_.push_back(items_[i]);
+    }
+    items_.swap(scratch_);
+
+    // Insertion sort costs one move per inversion, so it is only allowed a
+    // linear number of moves; a list that needs more goes to the radix sort.
+    if (n > 1 && !insertionSort(std::max<size_t>(n, kMinInsertionMoves)))
+        radixSort();
+
+    for (size_t i = 0; i < prev_ids_.size(); ++i)
+        prev_rank_[prev_ids_[i]] = kNoRank;
+    prev_ids_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t id = items_[i].id;
+        if (id >= prev_rank_.size())
+            prev_rank_.resize(static_cast<size_t>(id) + 1, kNoRank);
+        prev_rank_[id] = static_cast<uint32_t>(i);
+        prev_ids_[i] = id;
+    }
+}
+
+// Returns false, with items_ left a permutation of the input, once more
+// than max_moves element moves would be needed.
+bool VoxelDrawList::insertionSort(size_t max_moves) {
+    size_t moves = 0;
+    for (size_t i = 1; i < items_.size(); ++i) {
+        const Item item = items_[i];
+        size_t j = i;
+        while (j > 0 && items_[j - 1].key > item.key) {
+            items_[j] = items_[j - 1];
+            --j;
+            ++moves;
+        }
+        items_[j] = item;
+        if (moves > max_moves)
+            return false;
+    }
+    return true;
+}
+
+// LSD radix sort over 8-bit digits. Digits that are equal for every item
+// (e.g. unused key fields) are skipped.
+void VoxelDrawList::radixSort() {
+    const size_t n = items_.size();
+    uint32_t counts[8][256];
+    std::memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; ++i) {
+        const uint64_t key = items_[i].key;
+        for (int d = 0; d < 8; ++d)
+            counts[d][(key >> (d * 8)) & 0xFFu] += 1;
+    }
+    scratch_.resize(n);
+    for (int d = 0; d < 8; ++d) {
+        const uint32_t first_digit = static_cast<uint32_t>((items_[0].key >> (d * 8)) & 0xFFu);
+        if (counts[d][first_digit] == n)
+            continue;
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int b = 0; b < 256; ++b) {
+            offsets[b] = sum;
+            sum += counts[d][b];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t digit = static_cast<uint32_t>((items_[i].key >> (d * 8)) & 0xFFu);
+            scratch_[offsets[digit]++] = items_[i];
+        }
+        items_.swap(scratch_);
+    }
+}
+
+} // namespace voxel
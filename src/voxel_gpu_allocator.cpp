@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voxel_gpu_allocator.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace voxel {
+
+static const VkDeviceSize kDefaultBlockSize = 64ull * 1024ull * 1024ull;
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    if (alignment <= 1)
+        return value;
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+VoxelGpuAllocator::VoxelGpuAllocator()
+    : device_(VK_NULL_HANDLE)
+    , memory_properties_() {
+}
+
+void VoxelGpuAllocator::init(VkDevice device, VkPhysicalDevice physical_device) {
+    device_ = device;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+    pools_.clear();
+}
+
+void VoxelGpuAllocator::shutdown() {
+    for (size_t p = 0; p < pools_.size(); ++p) {
+        for (size_t b = 0; b < pools_[p].blocks.size(); ++b) {
+            Block& block = pools_[p].blocks[b];
+            if (block.memory && block.allocation_count > 0)
+                std::fprintf(stderr, "gpu allocator: %u allocation(s) still live in memory type %u at shutdown\n",
+                             block.allocation_count, pools_[p].memory_type);
+            destroyBlock(&block);
+        }
+    }
+    pools_.clear();
+    device_ = VK_NULL_HANDLE;
+}
+
+int VoxelGpuAllocator::findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; ++i) {
+        if ((type_filter & (1u << i)) && (memory_properties_.memoryTypes[i].propertyFlags & properties) == properties)
+            return (int)i;
+    }
+    return -1;
+}
+
+int VoxelGpuAllocator::findPool(uint32_t memory_type, ResourceKind kind) {
+    for (size_t i = 0; i < pools_.size(); ++i) {
+        if (pools_[i].memory_type == memory_type && pools_[i].kind == kind)
+            return (int)i;
+    }
+    Pool pool;
+    pool.memory_type = memory_type;
+    pool.kind = kind;
+    pools_.push_back(pool);
+    return (int)pools_.size() - 1;
+}
+
+int VoxelGpuAllocator::createBlock(Pool* pool, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = pool->memory_type;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(device_, &alloc_info, nullptr, &memory) != VK_SUCCESS)
+        return -1;
+
+    unsigned char* mapped = nullptr;
+    if (memory_properties_.memoryTypes[pool->memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&mapped)) != VK_SUCCESS) {
+            vkFreeMemory(device_, memory, nullptr);
+            return -1;
+        }
+    }
+
+    size_t slot = 0;
+    while (slot < pool->blocks.size() && pool->blocks[slot].memory != VK_NULL_HANDLE)
+        ++slot;
+    if (slot == pool->blocks.size())
+        pool->blocks.push_back(Block());
+    Block& block = pool->blocks[slot];
+    block = Block();
+    block.memory = memory;
+    block.size = size;
+    block.mapped = mapped;
+    block.dedicated = dedicated;
+    Range all = {0, size};
+    block.free_ranges.push_back(all);
+    return (int)slot;
+}
+
+void VoxelGpuAllocator::destroyBlock(Block* block) {
+    if (!block->memory)
+        return;
+    if (block->mapped)
+        vkUnmapMemory(device_, block->memory);
+    vkFreeMemory(device_, block->memory, nullptr);
+    *block = Block();
+}
+
+bool VoxelGpuAllocator::allocateFromBlock(Block* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* out_offset) {
+    std::vector<Range>& ranges = block->free_ranges;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        const Range range = ranges[i];
+        const VkDeviceSize offset = AlignUp(range.offset, alignment);
+        if (offset + size > range.offset + range.size)
+            continue;
+        // Alignment padding in front stays free, as does the tail.
+        const VkDeviceSize head = offset - range.offset;
+        const VkDeviceSize tail = range.offset + range.size - (offset + size);
+        if (head > 0 && tail > 0) {
+            ranges[i].size = head;
+            Range rest = {offset + size, tail};
+            ranges.insert(ranges.begin() + i + 1, rest);
+        } else if (head > 0) {
+            ranges[i].size = head;
+        } else if (tail > 0) {
+            ranges[i].offset = offset + size;
+            ranges[i].size = tail;
+        } else {
+            ranges.erase(ranges.begin() + i);
+        }
+        block->used += size;
+        block->allocation_count += 1;
+        *out_offset = offset;
+        return true;
+    }
+    return false;
+}
+
+void VoxelGpuAllocator::releaseToBlock(Block* block, VkDeviceSize offset, VkDeviceSize size) {
+    std::vector<Range>& ranges = block->free_ranges;
+    size_t i = 0;
+    while (i < ranges.size() && ranges[i].offset < offset)
+        ++i;
+    Range range = {offset, size};
+    ranges.insert(ranges.begin() + i, range);
+    if (i + 1 < ranges.size() && ranges[i].offset + ranges[i].size == ranges[i + 1].offset) {
+        ranges[i].size += ranges[i + 1].size;
+        ranges.erase(ranges.begin() + i + 1);
+    }
+    if (i > 0 && ranges[i - 1].offset + ranges[i - 1].size == ranges[i].offset) {
+        ranges[i - 1].size += ranges[i].size;
+        ranges.erase(ranges.begin() + i);
+    }
+    block->used -= size;
+    block->allocation_count -= 1;
+}
+
+bool VoxelGpuAllocator::allocate(const VkMemoryRequirements& reqs, VkMemoryPropertyFlags properties, ResourceKind kind,
+                                 VoxelGpuAllocation* out) {
+    *out = VoxelGpuAllocation();
+    const int memory_type = findMemoryType(reqs.memoryTypeBits, properties);
+    if (memory_type < 0) {
+        std::fprintf(stderr, "gpu allocator: no memory type for flags 0x%x\n", (unsigned)properties);
+        return false;
+    }
+    const int pool_index = findPool((uint32_t)memory_type, kind);
+    Pool& pool = pools_[pool_index];
+
+    // Small heaps (integrated GPUs, BAR windows) get smaller blocks.
+    const uint32_t heap = memory_properties_.memoryTypes[memory_type].heapIndex;
+    const VkDeviceSize block_size = std::min(kDefaultBlockSize, std::max<VkDeviceSize>(memory_properties_.memoryHeaps[heap].size / 8, 1));
+
+    int block_index = -1;
+    VkDeviceSize offset = 0;
+    if (reqs.size > block_size / 2) {
+        block_index = createBlock(&pool, reqs.size, true);
+        if (block_index >= 0)
+            allocateFromBlock(&pool.blocks[block_index], reqs.size, reqs.alignment, &offset);
+    } else {
+        for (size_t b = 0; b < pool.blocks.size(); ++b) {
+            Block& block = pool.blocks[b];
+            if (!block.memory || block.dedicated || block.size - block.used < reqs.size)
+                continue;
+            if (allocateFromBlock(&block, reqs.size, reqs.alignment, &offset)) {
+                block_index = (int)b;
+                break;
+            }
+        }
+        if (block_index < 0) {
+            block_index = createBlock(&pool, block_size, false);
+            if (block_index >= 0)
+                allocateFromBlock(&pool.blocks[block_index], reqs.size, reqs.alignment, &offset);
+        }
+    }
+    if (block_index < 0) {
+        std::fprintf(stderr, "gpu allocator: vkAllocateMemory failed (memory type %d, %llu bytes)\n",
+                     memory_type, (unsigned long long)reqs.size);
+        return false;
+    }
+
+    const Block& block = pool.blocks[block_index];
+    out->memory = block.memory;
+    out->offset = offset;
+    out->size = reqs.size;
+    out->mapped = block.mapped ? block.mapped + offset : nullptr;
+    out->pool = pool_index;
+    out->block = block_index;
+    return true;
+}
+
+void VoxelGpuAllocator::free(VoxelGpuAllocation* allocation) {
+    if (!allocation || !allocation->valid())
+        return;
+    Pool& pool = pools_[allocation->pool];
+    Block& block = pool.blocks[allocation->block];
+    releaseToBlock(&block, allocation->offset, allocation->size);
+    *allocation = VoxelGpuAllocation();
+    if (block.allocation_count > 0)
+        return;
+
+    // Keep one empty shared block per pool around so a free/allocate cycle
+    // does not round-trip through the driver.
+    bool other_shared = false;
+    for (size_t b = 0; b < pool.blocks.size(); ++b) {
+        if (&pool.blocks[b] != &block && pool.blocks[b].memory && !pool.blocks[b].dedicated)
+            other_shared = true;
+    }
+    if (block.dedicated || other_shared)
+        destroyBlock(&block);
+}
+
+VoxelGpuMemoryStats VoxelGpuAllocator::stats() const {
+    VoxelGpuMemoryStats stats;
+    VkDeviceSize total_free = 0;
+    for (size_t p = 0; p < pools_.size(); ++p) {
+        for (size_t b = 0; b < pools_[p].blocks.size(); ++b) {
+            const Block& block = pools_[p].blocks[b];
+            if (!block.memory)
+                continue;
+            stats.bytes_reserved += block.size;
+            stats.bytes_in_use += block.used;
+            stats.block_count += 1;
+            stats.allocation_count += block.allocation_count;
+            for (size_t r = 0; r < block.free_ranges.size(); ++r) {
+                total_free += block.free_ranges[r].size;
+                stats.largest_free_range = std::max(stats.largest_free_range, block.free_ranges[r].size);
+            }
+        }
+    }
+    if (total_free > 0)
+        stats.fragmentation = 1.0f - (float)((double)stats.largest_free_range / (double)total_free);
+    return stats;
+}
+
+} // namespace voxel
@@ -20,6 +20,7 @@
 
 #include "voxel_renderer.h"
 #include "gltf_loader.h"
+#include "voxel_math.h"
 
 #include <algorithm>
 #include <cmath>
@@ -30,8 +31,6 @@
 #include <string>
 #include <vector>
 
-#include "../third_party/stb_image.h"
-
 namespace voxel {
 
 VoxelRenderer::VoxelRenderer()
@@ -43,21 +42,25 @@ VoxelRenderer::VoxelRenderer()
     , pipeline_layout_(VK_NULL_HANDLE)
     , pipeline_(VK_NULL_HANDLE)
     , pipeline_skinned_(VK_NULL_HANDLE)
+    , pipeline_instanced_(VK_NULL_HANDLE)
+    , pipeline_compact_(VK_NULL_HANDLE)
+    , pipeline_skinned_compact_(VK_NULL_HANDLE)
     , vert_shader_(VK_NULL_HANDLE)
+    , instanced_vert_shader_(VK_NULL_HANDLE)
     , frag_shader_(VK_NULL_HANDLE)
     , descriptor_set_layout_(VK_NULL_HANDLE)
     , descriptor_pool_(VK_NULL_HANDLE)
     , descriptor_set_(VK_NULL_HANDLE)
     , texture_sampler_(VK_NULL_HANDLE)
     , skin_palette_buffer_(VK_NULL_HANDLE)
-    , skin_palette_memory_(VK_NULL_HANDLE)
+    , view_proj_buffer_(VK_NULL_HANDLE)
+    , view_proj_mapped_(nullptr)
+    , view_proj_stride_(0)
     , ground_texture_image_(VK_NULL_HANDLE)
-    , ground_texture_memory_(VK_NULL_HANDLE)
     , ground_texture_view_(VK_NULL_HANDLE)
     , ground_buffer_(VK_NULL_HANDLE)
-    , ground_memory_(VK_NULL_HANDLE)
     , cube_buffer_(VK_NULL_HANDLE)
-    , cube_memory_(VK_NULL_HANDLE)
+    , no_skin_buffer_(VK_NULL_HANDLE)
     , ground_vertex_count_(0)
     , cube_vertex_count_(0)
     , camera_yaw_(0.0f)
@@ -69,21 +72,37 @@ VoxelRenderer::VoxelRenderer()
     , pick_vert_shader_(VK_NULL_HANDLE)
     , pick_frag_shader_(VK_NULL_HANDLE)
     , pick_image_(VK_NULL_HANDLE)
-    , pick_image_memory_(VK_NULL_HANDLE)
     , pick_image_view_(VK_NULL_HANDLE)
     , pick_depth_image_(VK_NULL_HANDLE)
-    , pick_depth_memory_(VK_NULL_HANDLE)
     , pick_depth_view_(VK_NULL_HANDLE)
     , pick_framebuffer_(VK_NULL_HANDLE)
     , pick_extent_()
     , pick_command_pool_(VK_NULL_HANDLE)
     , pick_command_buffer_(VK_NULL_HANDLE)
-    , pick_fence_(VK_NULL_HANDLE) {
+    , pick_fence_(VK_NULL_HANDLE)
+    , staging_buffer_(VK_NULL_HANDLE)
+    , staging_mapped_(nullptr)
+    , staging_capacity_(0)
+    , staging_head_(0)
+    , upload_command_buffer_(VK_NULL_HANDLE)
+    , upload_fence_(VK_NULL_HANDLE)
+    , upload_recording_(false) {
     camera_pos_[0] = 6.0f;
     camera_pos_[1] = 6.0f;
     camera_pos_[2] = 6.0f;
 }
 
+VkFormat VoxelRenderer::findDepthFormat(VkPhysicalDevice physical_device) {
+    static const VkFormat kCandidates[3] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM};
+    for (int i = 0; i < 3; ++i) {
+        VkFormatProperties props = {};
+        vkGetPhysicalDeviceFormatProperties(physical_device, kCandidates[i], &props);
+        if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            return kCandidates[i];
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
 static float ToRadians(float degrees) {
     return degrees * 0.01745329252f;
 }
@@ -98,16 +117,8 @@ VoxelRenderer::Mat4 VoxelRenderer::mat4Identity() const {
 }
 
 VoxelRenderer::Mat4 VoxelRenderer::mat4Multiply(const Mat4& a, const Mat4& b) const {
-    Mat4 r = {};
-    for (int col = 0; col < 4; ++col) {
-        for (int row = 0; row < 4; ++row) {
-            r.m[col * 4 + row] =
-                a.m[0 * 4 + row] * b.m[col * 4 + 0] +
-                a.m[1 * 4 + row] * b.m[col * 4 + 1] +
-                a.m[2 * 4 + row] * b.m[col * 4 + 2] +
-                a.m[3 * 4 + row] * b.m[col * 4 + 3];
-        }
-    }
+    Mat4 r;
+    math::Mat4Mul(a.m, b.m, r.m);
     return r;
 }
 
@@ -217,17 +228,7 @@ static float BlockScaleMultiplierPercent(int scale_percent) {
     return static_cast<float>(scale_percent) / 100.0f;
 }
 
-uint32_t VoxelRenderer::findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
-    VkPhysicalDeviceMemoryProperties mem_properties;
-    vkGetPhysicalDeviceMemoryProperties(physical_device_, &mem_properties);
-    for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-        if ((type_filter & (1u << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties)
-            return i;
-    }
-    return 0;
-}
-
-bool VoxelRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* out_buffer, VkDeviceMemory* out_memory) {
+bool VoxelRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory) {
     VkBufferCreateInfo buffer_info = {};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_info.size = size;
@@ -238,19 +239,29 @@ bool VoxelRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Vk
 
     VkMemoryRequirements mem_reqs;
     vkGetBufferMemoryRequirements(device_, *out_buffer, &mem_reqs);
-
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, properties);
-    if (vkAllocateMemory(device_, &alloc_info, nullptr, out_memory) != VK_SUCCESS)
+    if (!gpu_allocator_.allocate(mem_reqs, properties, VoxelGpuAllocator::kLinear, out_memory)) {
+        vkDestroyBuffer(device_, *out_buffer, nullptr);
+        *out_buffer = VK_NULL_HANDLE;
         return false;
+    }
+    vkBindBufferMemory(device_, *out_buffer, out_memory->memory, out_memory->offset);
+    return true;
+}
 
-    vkBindBufferMemory(device_, *out_buffer, *out_memory, 0);
+bool VoxelRenderer::allocateImageMemory(VkImage image, VoxelGpuAllocation* out_memory) {
+    VkMemoryRequirements mem_reqs;
+    vkGetImageMemoryRequirements(device_, image, &mem_reqs);
+    if (!gpu_allocator_.allocate(mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VoxelGpuAllocator::kOptimal, out_memory))
+        return false;
+    vkBindImageMemory(device_, image, out_memory->memory, out_memory->offset);
     return true;
 }
 
-void VoxelRenderer::transitionImageLayout(VkCommandBuffer cmd, VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout) {
+VoxelGpuMemoryStats VoxelRenderer::memoryStats() const {
+    return gpu_allocator_.stats();
+}
+
+void VoxelRenderer::transitionImageLayout(VkCommandBuffer cmd, VkImage image, uint32_t base_level, uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout) {
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = old_layout;
@@ -258,8 +269,8 @@ void VoxelRenderer::transitionImageLayout(VkCommandBuffer cmd, VkImage image, Vk
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.image = image;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseMipLevel = base_level;
+    barrier.subresourceRange.levelCount = level_count;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
     barrier.subresourceRange.aspectMask = (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
@@ -280,18 +291,28 @@ void VoxelRenderer::transitionImageLayout(VkCommandBuffer cmd, VkImage image, Vk
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
         source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         dest_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dest_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dest_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
     }
 
     vkCmdPipelineBarrier(cmd, source_stage, dest_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
 
-void VoxelRenderer::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+void VoxelRenderer::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize buffer_offset, VkImage image, uint32_t mip_level, uint32_t width, uint32_t height) {
     VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
+    region.bufferOffset = buffer_offset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.mipLevel = mip_level;
     region.imageSubresource.baseArrayLayer = 0;
     region.imageSubresource.layerCount = 1;
     region.imageOffset = {0, 0, 0};
@@ -299,94 +320,219 @@ void VoxelRenderer::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkIm
     vkCmdCopyBufferToImage(cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 }
 
-bool VoxelRenderer::createTextureImage(const char* path, VkImage* out_image, VkDeviceMemory* out_memory, VkImageView* out_view) {
-    int tex_w = 0, tex_h = 0, tex_comp = 0;
-    unsigned char fallback_pixel[4] = {255, 0, 255, 255};
-    unsigned char* pixels = nullptr;
-    bool use_fallback = false;
-    if (path && path[0] != '\0')
-        pixels = stbi_load(path, &tex_w, &tex_h, &tex_comp, 4);
-    if (!pixels) {
-        use_fallback = true;
-        tex_w = 1;
-        tex_h = 1;
-        tex_comp = 4;
-        pixels = fallback_pixel;
-        std::fprintf(stderr, "Texture missing (%s) -> using fallback\n", path ? path : "<null>");
+static void DecodeTexture(const std::string& path, bool cpu_mips, VoxelTextureData* out) {
+    if (!LoadVoxelTexture(path, out)) {
+        static const unsigned char kFallbackPixel[4] = {255, 0, 255, 255};
+        std::fprintf(stderr, "Texture missing (%s) -> using fallback\n", path.empty() ? "<null>" : path.c_str());
+        *out = VoxelTextureData();
+        out->width = 1;
+        out->height = 1;
+        out->level_offsets.assign(1, 0);
+        out->pixels.assign(kFallbackPixel, kFallbackPixel + 4);
+        return;
     }
+    if (cpu_mips)
+        GenerateMipChainRgba8(out);
+}
 
-    VkDeviceSize image_size = (VkDeviceSize)tex_w * (VkDeviceSize)tex_h * 4;
-    VkBuffer staging_buffer = VK_NULL_HANDLE;
-    VkDeviceMemory staging_memory = VK_NULL_HANDLE;
-    if (!createBuffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer, &staging_memory))
-        return false;
+// Decodes all paths on the worker pool; out[i] belongs to paths[i].
+static void DecodeTextures(VoxelWorkerPool* workers, const std::vector<std::string>& paths, bool cpu_mips, std::vector<VoxelTextureData>* out) {
+    out->assign(paths.size(), VoxelTextureData());
+    workers->run(paths.size(), [&paths, cpu_mips, out](size_t i, unsigned int) {
+        DecodeTexture(paths[i], cpu_mips, &(*out)[i]);
+    });
+}
 
-    void* data = nullptr;
-    vkMapMemory(device_, staging_memory, 0, image_size, 0, &data);
-    std::memcpy(data, pixels, (size_t)image_size);
-    vkUnmapMemory(device_, staging_memory);
-    if (!use_fallback)
-        stbi_image_free(pixels);
+// Records the image upload into the current upload batch; the image is
+// ready for sampling after the next flushUploads(). Single-level RGBA8
+// textures get their mip chain from a blit chain on the GPU.
+bool VoxelRenderer::uploadTexture(const VoxelTextureData& texture, VkImage* out_image, VoxelGpuAllocation* out_memory, VkImageView* out_view) {
+    const bool blit_chain = blit_mips_ && !texture.isCompressed() && texture.levelCount() == 1;
+    const uint32_t level_count = blit_chain ? MipLevelCount(texture.width, texture.height) : texture.levelCount();
 
     VkImageCreateInfo image_info = {};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_info.imageType = VK_IMAGE_TYPE_2D;
-    image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
-    image_info.extent = {(uint32_t)tex_w, (uint32_t)tex_h, 1};
-    image_info.mipLevels = 1;
+    image_info.format = texture.format;
+    image_info.extent = {texture.width, texture.height, 1};
+    image_info.mipLevels = level_count;
     image_info.arrayLayers = 1;
     image_info.samples = VK_SAMPLE_COUNT_1_BIT;
     image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
     image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (blit_chain)
+        image_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    if (vkCreateImage(device_, &image_info, nullptr, out_image) != VK_SUCCESS)
+    if (vkCreateImage(device_, &image_info, nullptr, out_image) != VK_SUCCESS) {
+        *out_image = VK_NULL_HANDLE;
         return false;
-    VkMemoryRequirements mem_reqs;
-    vkGetImageMemoryRequirements(device_, *out_image, &mem_reqs);
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    if (vkAllocateMemory(device_, &alloc_info, nullptr, out_memory) != VK_SUCCESS)
-        return false;
-    vkBindImageMemory(device_, *out_image, *out_memory, 0);
-
-    VkCommandBuffer cmd = pick_command_buffer_;
-    vkResetCommandBuffer(cmd, 0);
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(cmd, &begin_info);
-    transitionImageLayout(cmd, *out_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(cmd, staging_buffer, *out_image, (uint32_t)tex_w, (uint32_t)tex_h);
-    transitionImageLayout(cmd, *out_image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    vkEndCommandBuffer(cmd);
-
-    VkSubmitInfo submit = {};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &cmd;
-    vkQueueSubmit(queue_, 1, &submit, pick_fence_);
-    vkWaitForFences(device_, 1, &pick_fence_, VK_TRUE, UINT64_MAX);
-    vkResetFences(device_, 1, &pick_fence_);
-
-    vkDestroyBuffer(device_, staging_buffer, nullptr);
-    vkFreeMemory(device_, staging_memory, nullptr);
+    }
 
+    // The view is created before any command references the image, so every
+    // failure below can still destroy what was created right away.
     VkImageViewCreateInfo view_info = {};
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     view_info.image = *out_image;
     view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    view_info.format = texture.format;
     view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.levelCount = level_count;
     view_info.subresourceRange.layerCount = 1;
-    if (vkCreateImageView(device_, &view_info, nullptr, out_view) != VK_SUCCESS)
+    VkDeviceSize staging_offset = 0;
+    *out_view = VK_NULL_HANDLE;
+    if (!allocateImageMemory(*out_image, out_memory) ||
+        vkCreateImageView(device_, &view_info, nullptr, out_view) != VK_SUCCESS ||
+        !reserveStaging(texture.pixels.size(), &staging_offset)) {
+        std::fprintf(stderr, "renderer: texture upload failed (%ux%u)\n", texture.width, texture.height);
+        if (*out_view)
+            vkDestroyImageView(device_, *out_view, nullptr);
+        vkDestroyImage(device_, *out_image, nullptr);
+        gpu_allocator_.free(out_memory);
+        *out_view = VK_NULL_HANDLE;
+        *out_image = VK_NULL_HANDLE;
+        return false;
+    }
+    std::memcpy(staging_mapped_ + staging_offset, texture.pixels.data(), texture.pixels.size());
+    VkCommandBuffer cmd = upload_command_buffer_;
+    transitionImageLayout(cmd, *out_image, 0, level_count, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    for (uint32_t level = 0; level < texture.levelCount(); ++level) {
+        copyBufferToImage(cmd, staging_buffer_, staging_offset + texture.level_offsets[level], *out_image, level,
+                          std::max(1u, texture.width >> level), std::max(1u, texture.height >> level));
+    }
+    if (blit_chain) {
+        int32_t src_w = (int32_t)texture.width;
+        int32_t src_h = (int32_t)texture.height;
+        for (uint32_t level = 1; level < level_count; ++level) {
+            const int32_t dst_w = std::max(1, src_w / 2);
+            const int32_t dst_h = std::max(1, src_h / 2);
+            transitionImageLayout(cmd, *out_image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+            VkImageBlit blit = {};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.layerCount = 1;
+            blit.srcOffsets[1] = {src_w, src_h, 1};
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.layerCount = 1;
+            blit.dstOffsets[1] = {dst_w, dst_h, 1};
+            vkCmdBlitImage(cmd, *out_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, *out_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &blit, VK_FILTER_LINEAR);
+            transitionImageLayout(cmd, *out_image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            src_w = dst_w;
+            src_h = dst_h;
+        }
+        transitionImageLayout(cmd, *out_image, level_count - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    } else {
+        transitionImageLayout(cmd, *out_image, 0, level_count, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    return true;
+}
+
+static const VkDeviceSize kStagingRingSize = 8u * 1024u * 1024u;
+
+// Static geometry goes to DEVICE_LOCAL memory through the staging ring; the
+// copy lands with the next flushUploads().
+bool VoxelRenderer::createStaticVertexBuffer(const void* vertices, VkDeviceSize buffer_size, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory) {
+    if (!createBuffer(buffer_size,
+                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                      out_buffer,
+                      out_memory) ||
+        !stageBufferUpload(vertices, buffer_size, *out_buffer)) {
+        if (*out_buffer)
+            vkDestroyBuffer(device_, *out_buffer, nullptr);
+        gpu_allocator_.free(out_memory);
+        *out_buffer = VK_NULL_HANDLE;
+        return createVertexBuffer(vertices, buffer_size, out_buffer, out_memory);
+    }
+    return true;
+}
+
+// Reserves `size` bytes of the staging ring and makes sure the upload
+// command buffer is recording. May flush the pending batch to make room.
+bool VoxelRenderer::reserveStaging(VkDeviceSize size, VkDeviceSize* out_offset) {
+    const VkDeviceSize aligned = (size + 15u) & ~VkDeviceSize(15u);
+    if (staging_head_ + aligned > staging_capacity_) {
+        if (!flushUploads())
+            return false;
+        if (aligned > staging_capacity_) {
+            if (staging_buffer_)
+                vkDestroyBuffer(device_, staging_buffer_, nullptr);
+            gpu_allocator_.free(&staging_memory_);
+            staging_buffer_ = VK_NULL_HANDLE;
+            staging_mapped_ = nullptr;
+            staging_capacity_ = 0;
+            const VkDeviceSize capacity = std::max(aligned, kStagingRingSize);
+            if (!createBuffer(capacity,
+                              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              &staging_buffer_,
+                              &staging_memory_)) {
+                std::fprintf(stderr, "renderer: staging buffer allocation failed (%llu bytes)\n", (unsigned long long)capacity);
+                return false;
+            }
+            staging_mapped_ = staging_memory_.mapped;
+            staging_capacity_ = capacity;
+        }
+    }
+
+    if (!upload_recording_) {
+        vkResetCommandBuffer(upload_command_buffer_, 0);
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(upload_command_buffer_, &begin_info) != VK_SUCCESS)
+            return false;
+        upload_recording_ = true;
+    }
+
+    *out_offset = staging_head_;
+    staging_head_ += aligned;
+    return true;
+}
+
+bool VoxelRenderer::stageBufferUpload(const void* data, VkDeviceSize size, VkBuffer dst_buffer) {
+    if (size == 0)
+        return true;
+    VkDeviceSize offset = 0;
+    if (!reserveStaging(size, &offset))
+        return false;
+    std::memcpy(staging_mapped_ + offset, data, (size_t)size);
+    VkBufferCopy region = {};
+    region.srcOffset = offset;
+    region.dstOffset = 0;
+    region.size = size;
+    vkCmdCopyBuffer(upload_command_buffer_, staging_buffer_, dst_buffer, 1, &region);
+    return true;
+}
+
+bool VoxelRenderer::flushUploads() {
+    if (!upload_recording_)
+        return true;
+    upload_recording_ = false;
+    staging_head_ = 0;
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(upload_command_buffer_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+    if (vkEndCommandBuffer(upload_command_buffer_) != VK_SUCCESS)
         return false;
 
+    VkSubmitInfo submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &upload_command_buffer_;
+    if (vkQueueSubmit(queue_, 1, &submit, upload_fence_) != VK_SUCCESS)
+        return false;
+    vkWaitForFences(device_, 1, &upload_fence_, VK_TRUE, UINT64_MAX);
+    vkResetFences(device_, 1, &upload_fence_);
     return true;
 }
+
 bool VoxelRenderer::createShaderModule(const char* path, VkShaderModule* out_module) {
     std::ifstream file(path, std::ios::ate | std::ios::binary);
     if (!file.is_open())
@@ -404,44 +550,84 @@ bool VoxelRenderer::createShaderModule(const char* path, VkShaderModule* out_mod
     return vkCreateShaderModule(device_, &info, nullptr, out_module) == VK_SUCCESS;
 }
 
-bool VoxelRenderer::createVertexBuffer(const Vertex* vertices, size_t count, VkBuffer* out_buffer, VkDeviceMemory* out_memory) {
-    VkDeviceSize buffer_size = sizeof(Vertex) * count;
-
-    VkBufferCreateInfo buffer_info = {};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = buffer_size;
-    buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if (vkCreateBuffer(device_, &buffer_info, nullptr, out_buffer) != VK_SUCCESS)
+bool VoxelRenderer::createVertexBuffer(const void* vertices, VkDeviceSize buffer_size, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory) {
+    if (!createBuffer(buffer_size,
+                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      out_buffer,
+                      out_memory))
         return false;
+    std::memcpy(out_memory->mapped, vertices, static_cast<size_t>(buffer_size));
+    return true;
+}
 
-    VkMemoryRequirements mem_reqs;
-    vkGetBufferMemoryRequirements(device_, *out_buffer, &mem_reqs);
+// Host-visible index buffers are for meshes whose triangle order is rewritten
+// per frame; everything else goes through the staging ring like
+// createStaticVertexBuffer().
+bool VoxelRenderer::createIndexBuffer(const uint32_t* indices, size_t count, bool host_visible, VkBuffer* out_buffer, VoxelGpuAllocation* out_memory) {
+    const VkDeviceSize buffer_size = sizeof(uint32_t) * count;
+    if (!host_visible) {
+        if (createBuffer(buffer_size,
+                         VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         out_buffer,
+                         out_memory) &&
+            stageBufferUpload(indices, buffer_size, *out_buffer))
+            return true;
+        if (*out_buffer)
+            vkDestroyBuffer(device_, *out_buffer, nullptr);
+        gpu_allocator_.free(out_memory);
+        *out_buffer = VK_NULL_HANDLE;
+    }
+    if (!createBuffer(buffer_size,
+                      VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      out_buffer,
+                      out_memory))
+        return false;
+    std::memcpy(out_memory->mapped, indices, static_cast<size_t>(buffer_size));
+    return true;
+}
 
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+// Frames still in flight may draw the mesh, so its buffers are retired
+// rather than destroyed.
+void VoxelRenderer::retireMeshBuffer(MeshBuffer* mesh) {
+    retireBuffer(mesh->buffer, mesh->memory);
+    retireBuffer(mesh->index_buffer, mesh->index_memory);
+    *mesh = MeshBuffer();
+}
 
-    if (vkAllocateMemory(device_, &alloc_info, nullptr, out_memory) != VK_SUCCESS)
-        return false;
+// Shaders written against the original fixed-size texture array declare 16
+// samplers, so binding 1 never shrinks below that.
+static const uint32_t kMinBlockTextureSlots = 16;
+static const uint32_t kBlockTextureCountConstantId = 0;
+static const uint32_t kInitialSkinPaletteJoints = 4096; // per frame in flight, doubled on demand
+static const bool kDisableSkinnedAnimationForDebug = false;
+static const float kSkinnedYawOffsetDeg = 180.0f;
+static const uint32_t kNoSkinPalette = 0xffffffffu;
+static const uint32_t kNoSkinBinding = 2;
 
-    vkBindBufferMemory(device_, *out_buffer, *out_memory, 0);
+static const size_t kSkinPosesPerWorker = 32;
 
-    void* data = nullptr;
-    vkMapMemory(device_, *out_memory, 0, buffer_size, 0, &data);
-    std::memcpy(data, vertices, static_cast<size_t>(buffer_size));
-    vkUnmapMemory(device_, *out_memory);
+static size_t ResolveClip(const GltfSkeleton& skeleton, int clip) {
+    return (clip >= 0 && (size_t)clip < skeleton.clips.size()) ? (size_t)clip : 0;
+}
 
-    return true;
+static float ClipDuration(const GltfSkeleton& skeleton, int clip) {
+    return skeleton.clips.empty() ? 0.0f : skeleton.clips[ResolveClip(skeleton, clip)].duration;
 }
 
-static const uint32_t kMaxBlockTextures = 16;
-static const uint32_t kMaxSkinPaletteJoints = 256;
-static const uint32_t kMaxSkinnedDrawsPerFrame = 64;
-static const bool kDisableSkinnedAnimationForDebug = false;
-static const float kSkinnedYawOffsetDeg = 180.0f;
+static void AdvanceAnimation(VoxelRenderer::AnimationState* state, float dt, float duration) {
+    if (duration <= 0.0001f) {
+        state->time = 0.0f;
+        return;
+    }
+    state->time += dt * state->speed;
+    if (state->loop_mode == VoxelRenderer::kAnimationLoop)
+        state->time -= duration * std::floor(state->time / duration);
+    else
+        state->time = std::min(std::max(state->time, 0.0f), duration);
+}
 
 bool VoxelRenderer::init(VkDevice device,
                          VkPhysicalDevice physical_device,
@@ -453,12 +639,23 @@ bool VoxelRenderer::init(VkDevice device,
                          const char* pick_vertex_shader_path,
                          const char* pick_fragment_shader_path,
                          const char* ground_texture_path,
-                         const std::vector<std::string>& block_texture_paths) {
+                         const std::vector<std::string>& block_texture_paths,
+                         bool main_pass_has_depth,
+                         const char* instanced_vertex_shader_path,
+                         uint32_t frames_in_flight) {
     device_ = device;
     physical_device_ = physical_device;
+    gpu_allocator_.init(device_, physical_device_);
+    worker_pool_.init();
     queue_ = queue;
     queue_family_ = queue_family;
     render_pass_ = render_pass;
+    // Chunk meshes give up the per-block back-to-front order, so they are only
+    // used when the caller's render pass resolves visibility with a depth buffer.
+    main_pass_has_depth_ = main_pass_has_depth;
+    // Sizes every per-frame ring and the retirement delay; it must match the
+    // number of command buffers the caller can have pending at once.
+    frames_in_flight_ = std::max(frames_in_flight, 1u);
 
     if (!createShaderModule(vertex_shader_path, &vert_shader_))
         return false;
@@ -468,24 +665,64 @@ bool VoxelRenderer::init(VkDevice device,
         return false;
     if (!createShaderModule(pick_fragment_shader_path, &pick_frag_shader_))
         return false;
+    // Instancing drops the per-block back-to-front order as well.
+    if (instanced_vertex_shader_path && main_pass_has_depth_ &&
+        !createShaderModule(instanced_vertex_shader_path, &instanced_vert_shader_))
+        return false;
 
-    VkDescriptorSetLayoutBinding sampler_bindings[3] = {};
+    // One descriptor per distinct texture path; the catalog index of a tile is
+    // mapped to its slot through texture_slots_.
+    VkPhysicalDeviceProperties device_props = {};
+    vkGetPhysicalDeviceProperties(physical_device_, &device_props);
+    const VkPhysicalDeviceLimits& limits = device_props.limits;
+    const uint32_t sampler_limit = std::min(std::min(limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages),
+                                            std::min(limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages));
+    const uint32_t max_texture_slots = std::max<uint32_t>(sampler_limit, 2u) - 1u; // binding 0 holds the ground texture
+    std::vector<std::string> catalog_paths = block_texture_paths;
+    if (catalog_paths.empty())
+        catalog_paths.push_back(ground_texture_path ? ground_texture_path : "");
+    std::vector<std::string> paths;
+    std::map<std::string, uint32_t> slot_by_path;
+    size_t dropped_textures = 0;
+    texture_slots_.assign(catalog_paths.size(), 0u);
+    for (size_t i = 0; i < catalog_paths.size(); ++i) {
+        std::map<std::string, uint32_t>::const_iterator found = slot_by_path.find(catalog_paths[i]);
+        if (found != slot_by_path.end()) {
+            texture_slots_[i] = found->second;
+        } else if (paths.size() < max_texture_slots) {
+            texture_slots_[i] = (uint32_t)paths.size();
+            slot_by_path[catalog_paths[i]] = texture_slots_[i];
+            paths.push_back(catalog_paths[i]);
+        } else {
+            dropped_textures += 1;
+        }
+    }
+    if (dropped_textures > 0)
+        std::fprintf(stderr, "renderer: %zu block texture(s) exceed the device limit of %u samplers, drawing them with texture 0\n",
+                     dropped_textures, max_texture_slots);
+    block_texture_count_ = std::min(std::max<uint32_t>((uint32_t)paths.size(), kMinBlockTextureSlots), max_texture_slots);
+
+    VkDescriptorSetLayoutBinding sampler_bindings[4] = {};
     sampler_bindings[0].binding = 0;
     sampler_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     sampler_bindings[0].descriptorCount = 1;
     sampler_bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     sampler_bindings[1].binding = 1;
     sampler_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    sampler_bindings[1].descriptorCount = kMaxBlockTextures;
+    sampler_bindings[1].descriptorCount = block_texture_count_;
     sampler_bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     sampler_bindings[2].binding = 2;
-    sampler_bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sampler_bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
     sampler_bindings[2].descriptorCount = 1;
     sampler_bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    sampler_bindings[3].binding = 3;
+    sampler_bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    sampler_bindings[3].descriptorCount = 1;
+    sampler_bindings[3].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
     VkDescriptorSetLayoutCreateInfo desc_layout_info = {};
     desc_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    desc_layout_info.bindingCount = 3;
+    desc_layout_info.bindingCount = 4;
     desc_layout_info.pBindings = sampler_bindings;
     if (vkCreateDescriptorSetLayout(device_, &desc_layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS)
         return false;
@@ -499,6 +736,18 @@ bool VoxelRenderer::init(VkDevice device,
     shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     shader_stages[1].module = frag_shader_;
     shader_stages[1].pName = "main";
+    // Lets the fragment shader size its texture array to the catalog:
+    // layout(constant_id = 0) const int kBlockTextureCount = 16;
+    VkSpecializationMapEntry texture_count_entry = {};
+    texture_count_entry.constantID = kBlockTextureCountConstantId;
+    texture_count_entry.offset = 0;
+    texture_count_entry.size = sizeof(uint32_t);
+    VkSpecializationInfo fragment_specialization = {};
+    fragment_specialization.mapEntryCount = 1;
+    fragment_specialization.pMapEntries = &texture_count_entry;
+    fragment_specialization.dataSize = sizeof(uint32_t);
+    fragment_specialization.pData = &block_texture_count_;
+    shader_stages[1].pSpecializationInfo = &fragment_specialization;
 
     VkVertexInputBindingDescription binding = {};
     binding.binding = 0;
@@ -631,6 +880,104 @@ bool VoxelRenderer::init(VkDevice device,
     if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info_skinned, nullptr, &pipeline_skinned_) != VK_SUCCESS)
         return false;
 
+    // Compact block mesh layouts. Static meshes carry no joints; locations 4-5
+    // read one constant entry through a zero-stride binding instead.
+    VkVertexInputBindingDescription static_bindings[2] = {};
+    static_bindings[0].binding = 0;
+    static_bindings[0].stride = sizeof(StaticVertex);
+    static_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static_bindings[1].binding = kNoSkinBinding;
+    static_bindings[1].stride = 0;
+    static_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription static_attributes[6] = {};
+    for (int i = 0; i < 6; ++i)
+        static_attributes[i] = attributes[i];
+    static_attributes[0].format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    static_attributes[0].offset = offsetof(StaticVertex, pos);
+    static_attributes[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    static_attributes[1].offset = offsetof(StaticVertex, color);
+    static_attributes[2].format = VK_FORMAT_R8G8B8A8_SNORM;
+    static_attributes[2].offset = offsetof(StaticVertex, normal);
+    static_attributes[3].format = VK_FORMAT_R16G16_SFLOAT;
+    static_attributes[3].offset = offsetof(StaticVertex, uv);
+    static_attributes[4].binding = kNoSkinBinding;
+    static_attributes[4].format = VK_FORMAT_R8G8B8A8_UINT;
+    static_attributes[4].offset = 0;
+    static_attributes[5].binding = kNoSkinBinding;
+    static_attributes[5].format = VK_FORMAT_R8G8B8A8_UNORM;
+    static_attributes[5].offset = 4;
+
+    VkPipelineVertexInputStateCreateInfo static_input = vertex_input;
+    static_input.vertexBindingDescriptionCount = 2;
+    static_input.pVertexBindingDescriptions = static_bindings;
+    static_input.pVertexAttributeDescriptions = static_attributes;
+    VkGraphicsPipelineCreateInfo pipeline_info_compact = pipeline_info;
+    pipeline_info_compact.pVertexInputState = &static_input;
+    if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info_compact, nullptr, &pipeline_compact_) != VK_SUCCESS)
+        return false;
+
+    VkVertexInputBindingDescription skinned_binding = binding;
+    skinned_binding.stride = sizeof(SkinnedVertex);
+    VkVertexInputAttributeDescription skinned_attributes[6] = {};
+    for (int i = 0; i < 6; ++i)
+        skinned_attributes[i] = static_attributes[i];
+    skinned_attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    skinned_attributes[0].offset = offsetof(SkinnedVertex, pos);
+    skinned_attributes[1].offset = offsetof(SkinnedVertex, color);
+    skinned_attributes[2].offset = offsetof(SkinnedVertex, normal);
+    skinned_attributes[3].offset = offsetof(SkinnedVertex, uv);
+    skinned_attributes[4].binding = 0;
+    skinned_attributes[4].offset = offsetof(SkinnedVertex, joints);
+    skinned_attributes[5].binding = 0;
+    skinned_attributes[5].offset = offsetof(SkinnedVertex, weights);
+
+    VkPipelineVertexInputStateCreateInfo skinned_input = vertex_input;
+    skinned_input.pVertexBindingDescriptions = &skinned_binding;
+    skinned_input.pVertexAttributeDescriptions = skinned_attributes;
+    VkGraphicsPipelineCreateInfo pipeline_info_skinned_compact = pipeline_info_skinned;
+    pipeline_info_skinned_compact.pVertexInputState = &skinned_input;
+    if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info_skinned_compact, nullptr, &pipeline_skinned_compact_) != VK_SUCCESS)
+        return false;
+
+    if (instanced_vert_shader_ != VK_NULL_HANDLE) {
+        VkPipelineShaderStageCreateInfo instanced_stages[2] = {shader_stages[0], shader_stages[1]};
+        instanced_stages[0].module = instanced_vert_shader_;
+
+        // Instanced draws only take kVertexLayoutStatic meshes.
+        VkVertexInputBindingDescription instanced_bindings[3] = {static_bindings[0], {}, static_bindings[1]};
+        instanced_bindings[1].binding = 1;
+        instanced_bindings[1].stride = sizeof(InstanceData);
+        instanced_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        VkVertexInputAttributeDescription instanced_attributes[11] = {};
+        for (int i = 0; i < 6; ++i)
+            instanced_attributes[i] = static_attributes[i];
+        for (uint32_t col = 0; col < 4; ++col) {
+            instanced_attributes[6 + col].binding = 1;
+            instanced_attributes[6 + col].location = 6 + col;
+            instanced_attributes[6 + col].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            instanced_attributes[6 + col].offset = offsetof(InstanceData, model) + sizeof(float) * 4 * col;
+        }
+        instanced_attributes[10].binding = 1;
+        instanced_attributes[10].location = 10;
+        instanced_attributes[10].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        instanced_attributes[10].offset = offsetof(InstanceData, tint);
+
+        VkPipelineVertexInputStateCreateInfo instanced_input = vertex_input;
+        instanced_input.vertexBindingDescriptionCount = 3;
+        instanced_input.pVertexBindingDescriptions = instanced_bindings;
+        instanced_input.vertexAttributeDescriptionCount = 11;
+        instanced_input.pVertexAttributeDescriptions = instanced_attributes;
+
+        VkGraphicsPipelineCreateInfo pipeline_info_instanced = pipeline_info;
+        pipeline_info_instanced.pStages = instanced_stages;
+        pipeline_info_instanced.pVertexInputState = &instanced_input;
+        if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info_instanced, nullptr, &pipeline_instanced_) != VK_SUCCESS)
+            return false;
+        instance_buffers_.assign(frames_in_flight_, InstanceBuffer());
+    }
+
     VkCommandPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -650,21 +997,46 @@ bool VoxelRenderer::init(VkDevice device,
     fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     if (vkCreateFence(device_, &fence_info, nullptr, &pick_fence_) != VK_SUCCESS)
         return false;
-
-    if (!createTextureImage(ground_texture_path, &ground_texture_image_, &ground_texture_memory_, &ground_texture_view_))
+    if (vkAllocateCommandBuffers(device_, &cmd_info, &upload_command_buffer_) != VK_SUCCESS)
+        return false;
+    if (vkCreateFence(device_, &fence_info, nullptr, &upload_fence_) != VK_SUCCESS)
         return false;
 
     block_textures_.clear();
-    std::vector<std::string> paths = block_texture_paths;
-    if (paths.empty())
-        paths.push_back(ground_texture_path);
-    if (paths.size() > kMaxBlockTextures)
-        paths.resize(kMaxBlockTextures);
+    // Decode everything in parallel, then record all uploads into one batch
+    // that is submitted with the static meshes at the end of init().
+    std::vector<std::string> decode_paths;
+    decode_paths.reserve(1 + paths.size());
+    decode_paths.push_back(ground_texture_path ? ground_texture_path : "");
+    decode_paths.insert(decode_paths.end(), paths.begin(), paths.end());
+    // RGBA8 mip chains come from a GPU blit chain when the format supports
+    // linear blits, otherwise the decode workers box-filter them.
+    VkFormatProperties rgba_props = {};
+    vkGetPhysicalDeviceFormatProperties(physical_device_, VK_FORMAT_R8G8B8A8_UNORM, &rgba_props);
+    const VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                               VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    blit_mips_ = (rgba_props.optimalTilingFeatures & blit_features) == blit_features;
+    std::vector<VoxelTextureData> decoded;
+    DecodeTextures(&worker_pool_, decode_paths, !blit_mips_, &decoded);
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        if (!decoded[i].isCompressed())
+            continue;
+        VkFormatProperties bc_props = {};
+        vkGetPhysicalDeviceFormatProperties(physical_device_, decoded[i].format, &bc_props);
+        if (!(bc_props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+            std::fprintf(stderr, "renderer: compressed texture %s not supported by the device\n", decode_paths[i].c_str());
+            DecodeTexture(std::string(), false, &decoded[i]);
+        }
+    }
+
+    if (!uploadTexture(decoded[0], &ground_texture_image_, &ground_texture_memory_, &ground_texture_view_))
+        return false;
     for (size_t i = 0; i < paths.size(); ++i) {
         BlockTexture tex = {};
-        if (!createTextureImage(paths[i].c_str(), &tex.image, &tex.memory, &tex.view))
+        if (!uploadTexture(decoded[1 + i], &tex.image, &tex.memory, &tex.view))
             return false;
         block_textures_.push_back(tex);
+        std::vector<unsigned char>().swap(decoded[1 + i].pixels);
     }
 
     VkSamplerCreateInfo sampler_info = {};
@@ -674,86 +1046,51 @@ bool VoxelRenderer::init(VkDevice device,
     sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
     sampler_info.maxAnisotropy = 1.0f;
     if (vkCreateSampler(device_, &sampler_info, nullptr, &texture_sampler_) != VK_SUCCESS)
         return false;
 
-    VkDescriptorPoolSize pool_sizes_desc[2] = {};
+    // Growing the skin palette replaces the descriptor set while older frames
+    // may still be reading the previous one. render() grows at most once, and
+    // a retired set is freed frames_in_flight frames later, so the pool holds
+    // the live set, its replacement and one retired set per frame in flight.
+    const uint32_t max_sets = frames_in_flight_ + 2u;
+    VkDescriptorPoolSize pool_sizes_desc[3] = {};
     pool_sizes_desc[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_sizes_desc[0].descriptorCount = 1 + kMaxBlockTextures;
-    pool_sizes_desc[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    pool_sizes_desc[1].descriptorCount = 1;
+    pool_sizes_desc[0].descriptorCount = (1 + block_texture_count_) * max_sets;
+    pool_sizes_desc[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    pool_sizes_desc[1].descriptorCount = max_sets;
+    pool_sizes_desc[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    pool_sizes_desc[2].descriptorCount = max_sets;
     VkDescriptorPoolCreateInfo pool_info_desc = {};
     pool_info_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info_desc.poolSizeCount = 2;
+    pool_info_desc.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    pool_info_desc.poolSizeCount = 3;
     pool_info_desc.pPoolSizes = pool_sizes_desc;
-    pool_info_desc.maxSets = 1;
+    pool_info_desc.maxSets = max_sets;
     if (vkCreateDescriptorPool(device_, &pool_info_desc, nullptr, &descriptor_pool_) != VK_SUCCESS)
         return false;
 
-    if (!createBuffer(sizeof(float) * 16 * kMaxSkinPaletteJoints * kMaxSkinnedDrawsPerFrame,
-                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                      &skin_palette_buffer_,
-                      &skin_palette_memory_))
+    skin_palette_align_ = std::max<VkDeviceSize>(device_props.limits.minStorageBufferOffsetAlignment, 1);
+    if (!ensureSkinPaletteCapacity(kInitialSkinPaletteJoints))
         return false;
-    {
-        float* mapped = nullptr;
-        vkMapMemory(device_, skin_palette_memory_, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&mapped));
-        for (uint32_t i = 0; i < kMaxSkinPaletteJoints * kMaxSkinnedDrawsPerFrame; ++i) {
-            float* m = mapped + i * 16;
-            for (int k = 0; k < 16; ++k)
-                m[k] = 0.0f;
-            m[0] = m[5] = m[10] = m[15] = 1.0f;
-        }
-        vkUnmapMemory(device_, skin_palette_memory_);
-    }
 
-    VkDescriptorSetAllocateInfo alloc_info_desc = {};
-    alloc_info_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info_desc.descriptorPool = descriptor_pool_;
-    alloc_info_desc.descriptorSetCount = 1;
-    alloc_info_desc.pSetLayouts = &descriptor_set_layout_;
-    if (vkAllocateDescriptorSets(device_, &alloc_info_desc, &descriptor_set_) != VK_SUCCESS)
+    // One view-projection slot per frame in flight, selected with a dynamic offset.
+    const VkDeviceSize ubo_align = std::max<VkDeviceSize>(device_props.limits.minUniformBufferOffsetAlignment, 1);
+    view_proj_stride_ = ((sizeof(Mat4) + ubo_align - 1) / ubo_align) * ubo_align;
+    if (!createBuffer(view_proj_stride_ * frames_in_flight_,
+                      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      &view_proj_buffer_,
+                      &view_proj_memory_))
         return false;
+    view_proj_mapped_ = view_proj_memory_.mapped;
 
-    VkDescriptorImageInfo image_infos[1 + kMaxBlockTextures] = {};
-    image_infos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    image_infos[0].imageView = ground_texture_view_;
-    image_infos[0].sampler = texture_sampler_;
-    for (uint32_t i = 0; i < kMaxBlockTextures; ++i) {
-        const BlockTexture& tex = (i < block_textures_.size()) ? block_textures_[i] : block_textures_[0];
-        image_infos[1 + i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        image_infos[1 + i].imageView = tex.view;
-        image_infos[1 + i].sampler = texture_sampler_;
-    }
-
-    VkDescriptorBufferInfo skin_info = {};
-    skin_info.buffer = skin_palette_buffer_;
-    skin_info.offset = 0;
-    skin_info.range = VK_WHOLE_SIZE;
-
-    VkWriteDescriptorSet writes[3] = {};
-    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[0].dstSet = descriptor_set_;
-    writes[0].dstBinding = 0;
-    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writes[0].descriptorCount = 1;
-    writes[0].pImageInfo = &image_infos[0];
-    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[1].dstSet = descriptor_set_;
-    writes[1].dstBinding = 1;
-    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writes[1].descriptorCount = kMaxBlockTextures;
-    writes[1].pImageInfo = &image_infos[1];
-    writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writes[2].dstSet = descriptor_set_;
-    writes[2].dstBinding = 2;
-    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    writes[2].descriptorCount = 1;
-    writes[2].pBufferInfo = &skin_info;
-    vkUpdateDescriptorSets(device_, 3, writes, 0, nullptr);
+    if (!allocateDescriptorSet(&descriptor_set_))
+        return false;
 
     VkAttachmentDescription color_attachment = {};
     color_attachment.format = VK_FORMAT_R32_UINT;
@@ -913,9 +1250,14 @@ bool VoxelRenderer::init(VkDevice device,
     };
     cube_vertex_count_ = 36;
 
-    if (!createVertexBuffer(ground_vertices, ground_vertex_count_, &ground_buffer_, &ground_memory_))
+    if (!createStaticVertexBuffer(ground_vertices, sizeof(ground_vertices), &ground_buffer_, &ground_memory_))
+        return false;
+    if (!createStaticVertexBuffer(cube_vertices, sizeof(cube_vertices), &cube_buffer_, &cube_memory_))
         return false;
-    if (!createVertexBuffer(cube_vertices, cube_vertex_count_, &cube_buffer_, &cube_memory_))
+    const uint8_t no_skin[8] = {0, 0, 0, 0, 255, 0, 0, 0}; // joint 0 at full weight
+    if (!createStaticVertexBuffer(no_skin, sizeof(no_skin), &no_skin_buffer_, &no_skin_memory_))
+        return false;
+    if (!flushUploads())
         return false;
 
     return true;
@@ -926,29 +1268,43 @@ void VoxelRenderer::shutdown() {
         return;
     if (ground_buffer_)
         vkDestroyBuffer(device_, ground_buffer_, nullptr);
-    if (ground_memory_)
-        vkFreeMemory(device_, ground_memory_, nullptr);
+    gpu_allocator_.free(&ground_memory_);
     if (cube_buffer_)
         vkDestroyBuffer(device_, cube_buffer_, nullptr);
-    if (cube_memory_)
-        vkFreeMemory(device_, cube_memory_, nullptr);
-    for (size_t i = 0; i < block_meshes_.size(); ++i) {
-        if (block_meshes_[i].buffer)
-            vkDestroyBuffer(device_, block_meshes_[i].buffer, nullptr);
-        if (block_meshes_[i].memory)
-            vkFreeMemory(device_, block_meshes_[i].memory, nullptr);
-    }
+    gpu_allocator_.free(&cube_memory_);
+    if (no_skin_buffer_)
+        vkDestroyBuffer(device_, no_skin_buffer_, nullptr);
+    gpu_allocator_.free(&no_skin_memory_);
+    for (size_t i = 0; i < block_meshes_.size(); ++i)
+        retireMeshBuffer(&block_meshes_[i]);
     block_meshes_.clear();
+    for (std::map<ChunkKey, ChunkBuffer>::iterator it = chunk_buffers_.begin(); it != chunk_buffers_.end(); ++it) {
+        for (size_t s = 0; s < it->second.sections.size(); ++s)
+            retireBuffer(it->second.sections[s].buffer, it->second.sections[s].memory);
+    }
+    chunk_buffers_.clear();
+    for (size_t i = 0; i < instance_buffers_.size(); ++i)
+        retireBuffer(instance_buffers_[i].buffer, instance_buffers_[i].memory);
+    instance_buffers_.clear();
+    releaseRetiredBuffers(true);
     if (pipeline_)
         vkDestroyPipeline(device_, pipeline_, nullptr);
     if (pipeline_skinned_)
         vkDestroyPipeline(device_, pipeline_skinned_, nullptr);
+    if (pipeline_instanced_)
+        vkDestroyPipeline(device_, pipeline_instanced_, nullptr);
+    if (pipeline_compact_)
+        vkDestroyPipeline(device_, pipeline_compact_, nullptr);
+    if (pipeline_skinned_compact_)
+        vkDestroyPipeline(device_, pipeline_skinned_compact_, nullptr);
     if (pipeline_layout_)
         vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
     if (vert_shader_)
         vkDestroyShaderModule(device_, vert_shader_, nullptr);
     if (frag_shader_)
         vkDestroyShaderModule(device_, frag_shader_, nullptr);
+    if (instanced_vert_shader_)
+        vkDestroyShaderModule(device_, instanced_vert_shader_, nullptr);
     if (descriptor_pool_)
         vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
     if (descriptor_set_layout_)
@@ -957,21 +1313,21 @@ void VoxelRenderer::shutdown() {
         vkDestroySampler(device_, texture_sampler_, nullptr);
     if (skin_palette_buffer_)
         vkDestroyBuffer(device_, skin_palette_buffer_, nullptr);
-    if (skin_palette_memory_)
-        vkFreeMemory(device_, skin_palette_memory_, nullptr);
+    gpu_allocator_.free(&skin_palette_memory_);
+    if (view_proj_buffer_)
+        vkDestroyBuffer(device_, view_proj_buffer_, nullptr);
+    gpu_allocator_.free(&view_proj_memory_);
     if (ground_texture_view_)
         vkDestroyImageView(device_, ground_texture_view_, nullptr);
     if (ground_texture_image_)
         vkDestroyImage(device_, ground_texture_image_, nullptr);
-    if (ground_texture_memory_)
-        vkFreeMemory(device_, ground_texture_memory_, nullptr);
+    gpu_allocator_.free(&ground_texture_memory_);
     for (size_t i = 0; i < block_textures_.size(); ++i) {
         if (block_textures_[i].view)
             vkDestroyImageView(device_, block_textures_[i].view, nullptr);
         if (block_textures_[i].image)
             vkDestroyImage(device_, block_textures_[i].image, nullptr);
-        if (block_textures_[i].memory)
-            vkFreeMemory(device_, block_textures_[i].memory, nullptr);
+        gpu_allocator_.free(&block_textures_[i].memory);
     }
     block_textures_.clear();
     if (pick_pipeline_)
@@ -988,20 +1344,25 @@ void VoxelRenderer::shutdown() {
         vkDestroyImageView(device_, pick_image_view_, nullptr);
     if (pick_image_)
         vkDestroyImage(device_, pick_image_, nullptr);
-    if (pick_image_memory_)
-        vkFreeMemory(device_, pick_image_memory_, nullptr);
+    gpu_allocator_.free(&pick_image_memory_);
     if (pick_depth_view_)
         vkDestroyImageView(device_, pick_depth_view_, nullptr);
     if (pick_depth_image_)
         vkDestroyImage(device_, pick_depth_image_, nullptr);
-    if (pick_depth_memory_)
-        vkFreeMemory(device_, pick_depth_memory_, nullptr);
+    gpu_allocator_.free(&pick_depth_memory_);
     if (pick_render_pass_)
         vkDestroyRenderPass(device_, pick_render_pass_, nullptr);
     if (pick_command_pool_)
         vkDestroyCommandPool(device_, pick_command_pool_, nullptr);
     if (pick_fence_)
         vkDestroyFence(device_, pick_fence_, nullptr);
+    if (upload_fence_)
+        vkDestroyFence(device_, upload_fence_, nullptr);
+    if (staging_buffer_)
+        vkDestroyBuffer(device_, staging_buffer_, nullptr);
+    gpu_allocator_.free(&staging_memory_);
+    gpu_allocator_.shutdown();
+    worker_pool_.shutdown();
     device_ = VK_NULL_HANDLE;
 }
 
@@ -1021,6 +1382,11 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
     last_render_time_ = now;
     has_last_render_time_ = true;
 
+    frame_index_ += 1;
+    releaseRetiredBuffers(false);
+    updateChunkBuffers();
+    updateAnimations(dt);
+
     VkViewport viewport = {};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
@@ -1035,10 +1401,6 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
     scissor.extent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
     vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    if (descriptor_set_ != VK_NULL_HANDLE) {
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &descriptor_set_, 0, nullptr);
-    }
-
     float aspect = width > 0 ? (float)width / (float)height : 1.0f;
     Mat4 proj = mat4Perspective(ToRadians(60.0f), aspect, 0.1f, 100.0f);
     proj.m[5] *= -1.0f;
@@ -1052,17 +1414,24 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
     Mat4 view = mat4LookAt(camera_pos_[0], camera_pos_[1], camera_pos_[2],
                            camera_pos_[0] + fx, camera_pos_[1] + fy, camera_pos_[2] + fz,
                            0.0f, 1.0f, 0.0f);
+    const Mat4 view_proj = mat4Multiply(proj, view);
+
+    const uint32_t frame_slot = static_cast<uint32_t>(frame_index_ % frames_in_flight_);
+    if (descriptor_set_ != VK_NULL_HANDLE) {
+        if (view_proj_mapped_)
+            std::memcpy(view_proj_mapped_ + view_proj_stride_ * frame_slot, &view_proj, sizeof(Mat4));
+        bindDescriptorSet(cmd, frame_slot);
+    }
 
     VkDeviceSize offset = 0;
     vkCmdBindVertexBuffers(cmd, 0, 1, &ground_buffer_, &offset);
-    Mat4 ground_model = mat4Identity();
     struct PushConstants {
         Mat4 mvp;
         float tint[4];
         uint32_t skin[4];
     };
     PushConstants ground_pc = {};
-    ground_pc.mvp = mat4Multiply(proj, mat4Multiply(view, ground_model));
+    ground_pc.mvp = view_proj; // the ground's model matrix is the identity
     ground_pc.tint[0] = 1.0f;
     ground_pc.tint[1] = 1.0f;
     ground_pc.tint[2] = 1.0f;
@@ -1075,28 +1444,157 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
     vkCmdPushConstants(cmd, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &ground_pc);
     vkCmdDraw(cmd, ground_vertex_count_, 1, 0, 0);
 
-    float* skin_palette_mapped = nullptr;
-    bool skin_palette_is_mapped = false;
-    uint32_t skinned_draw_slot = 0;
+    const VoxelFrustum frustum = VoxelFrustum::fromMatrix(view_proj.m);
+    if (!chunk_buffers_.empty()) {
+        PushConstants chunk_pc = ground_pc;
+        chunk_pc.mvp = view_proj;
+        chunk_pc.tint[3] = 0.0f;
+        for (std::map<ChunkKey, ChunkBuffer>::const_iterator it = chunk_buffers_.begin(); it != chunk_buffers_.end(); ++it) {
+            if (!frustum.intersects(it->second.bounds))
+                continue;
+            for (size_t s = 0; s < it->second.sections.size(); ++s) {
+                const ChunkSection& section = it->second.sections[s];
+                if (!section.buffer || section.vertex_count == 0)
+                    continue;
+                chunk_pc.tint[3] = (float)textureSlot(section.tex_index);
+                vkCmdBindVertexBuffers(cmd, 0, 1, &section.buffer, &offset);
+                vkCmdPushConstants(cmd, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &chunk_pc);
+                vkCmdDraw(cmd, section.vertex_count, 1, 0, 0);
+            }
+        }
+    }
+
     if (!blocks_.empty()) {
-        struct DrawItem {
-            size_t index;
-            float dist2;
-        };
-        std::vector<DrawItem> draw_items;
-        draw_items.reserve(blocks_.size());
-        for (size_t i = 0; i < blocks_.size(); ++i) {
-            float dx = blocks_[i].x - camera_pos_[0];
-            float dy = blocks_[i].y - camera_pos_[1];
-            float dz = blocks_[i].z - camera_pos_[2];
-            draw_items.push_back(DrawItem{i, dx * dx + dy * dy + dz * dz});
+        InstanceBuffer* instances = nullptr;
+        if (pipeline_instanced_ != VK_NULL_HANDLE && ensureInstanceCapacity(&instance_buffers_[frame_slot], blocks_.size()))
+            instances = &instance_buffers_[frame_slot];
+        // Blocks sharing a static mesh go into one instanced draw; skinned
+        // meshes keep the per-block path for their palette upload, as do
+        // full-layout meshes and the cube fallback. With a depth buffer the
+        // per-block draws are ordered by state and then front-to-back; without
+        // one they are all painted back-to-front.
+        block_draws_.clear();
+        instance_draws_.clear();
+        std::vector<uint32_t> visible;
+        visible.reserve(blocks_.size());
+        block_tree_.queryFrustum(frustum, &visible);
+        for (size_t v = 0; v < visible.size(); ++v) {
+            const uint32_t i = visible[v];
+            if (block_in_chunk_[i])
+                continue;
+            const Block& block = blocks_[i];
+            const float dx = block.x - camera_pos_[0];
+            const float dy = block.y - camera_pos_[1];
+            const float dz = block.z - camera_pos_[2];
+            const float dist2 = dx * dx + dy * dy + dz * dz;
+            const MeshBuffer* mesh = blockMesh(block);
+            const uint32_t mesh_field = mesh ? static_cast<uint32_t>(block.mesh_index + 1) : 0u;
+            const bool skinned = (mesh && mesh->is_skinned);
+            if (instances && mesh && mesh->layout == kVertexLayoutStatic) {
+                instance_draws_.add(VoxelDrawList::opaqueKey(0, mesh_field, 0, dist2), i);
+            } else if (main_pass_has_depth_) {
+                const uint32_t tex_field = textureSlot(block.tex_index);
+                const uint32_t pipeline_field = (mesh ? (uint32_t)mesh->layout : 0u) * 2u + (skinned ? 1u : 0u);
+                block_draws_.add(VoxelDrawList::opaqueKey(pipeline_field, mesh_field, tex_field, dist2), i);
+            } else {
+                block_draws_.add(VoxelDrawList::backToFrontKey(dist2), i);
+            }
+        }
+        block_draws_.sort();
+        instance_draws_.sort();
+
+        // Skinned draws of the same mesh, clip and time share one pose.
+        // Requests are sorted so each distinct pose is evaluated once into
+        // this frame's region of the ring; the ring grows before recording
+        // if the distinct poses don't fit.
+        skin_requests_.clear();
+        for (size_t i = 0; i < block_draws_.size(); ++i) {
+            const Block& block = blocks_[block_draws_[i].id];
+            const MeshBuffer* mesh = blockMesh(block);
+            if (!mesh || !mesh->is_skinned || !mesh->skeleton || mesh->joint_count == 0)
+                continue;
+            const AnimationState& state = block_animation_[block_draws_[i].id];
+            SkinRequest request;
+            request.mesh = static_cast<uint32_t>(block.mesh_index);
+            request.clip = static_cast<uint32_t>(ResolveClip(*mesh->skeleton, state.clip));
+            request.time = state.time;
+            if (skin_pose_time_quantum_ > 0.0f)
+                request.time = std::floor(state.time / skin_pose_time_quantum_ + 0.5f) * skin_pose_time_quantum_;
+            request.draw = static_cast<uint32_t>(i);
+            skin_requests_.push_back(request);
+        }
+        std::sort(skin_requests_.begin(), skin_requests_.end(), [](const SkinRequest& lhs, const SkinRequest& rhs) {
+            if (lhs.mesh != rhs.mesh)
+                return lhs.mesh < rhs.mesh;
+            if (lhs.clip != rhs.clip)
+                return lhs.clip < rhs.clip;
+            return lhs.time < rhs.time;
+        });
+        skin_poses_.clear();
+        skin_draw_base_.assign(block_draws_.size(), kNoSkinPalette);
+        uint32_t skin_joints_needed = 0;
+        for (size_t r = 0; r < skin_requests_.size(); ++r) {
+            const SkinRequest& request = skin_requests_[r];
+            if (skin_poses_.empty() || skin_poses_.back().mesh != request.mesh ||
+                skin_poses_.back().clip != request.clip || skin_poses_.back().time != request.time) {
+                SkinPose pose;
+                pose.mesh = request.mesh;
+                pose.clip = request.clip;
+                pose.time = request.time;
+                pose.joint_base = skin_joints_needed;
+                skin_poses_.push_back(pose);
+                skin_joints_needed += block_meshes_[request.mesh].joint_count;
+            }
+            skin_draw_base_[request.draw] = skin_poses_.back().joint_base;
+        }
+        const VkDescriptorSet bound_set = descriptor_set_;
+        if (ensureSkinPaletteCapacity(skin_joints_needed) && skin_palette_memory_.mapped) {
+            evaluateSkinPoses(reinterpret_cast<float*>(skin_palette_memory_.mapped + skin_palette_stride_ * frame_slot));
+        } else {
+            skin_draw_base_.assign(block_draws_.size(), kNoSkinPalette);
+        }
+        if (descriptor_set_ != bound_set)
+            bindDescriptorSet(cmd, frame_slot);
+
+        if (instance_draws_.size() > 0) {
+            for (size_t i = 0; i < instance_draws_.size(); ++i) {
+                const Block& block = blocks_[instance_draws_[i].id];
+                InstanceData& inst = instances->mapped[i];
+                std::memcpy(inst.model, block_models_[instance_draws_[i].id].m, sizeof(inst.model));
+                const bool selected = (selected_flags_[instance_draws_[i].id] != 0);
+                inst.tint[0] = 1.0f;
+                inst.tint[1] = 1.0f;
+                inst.tint[2] = selected ? 0.1f : 1.0f;
+                inst.tint[3] = (float)textureSlot(block.tex_index);
+            }
+            PushConstants inst_pc = ground_pc;
+            inst_pc.mvp = view_proj;
+            inst_pc.tint[3] = 0.0f;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_instanced_);
+            vkCmdPushConstants(cmd, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &inst_pc);
+            vkCmdBindVertexBuffers(cmd, 1, 1, &instances->buffer, &offset);
+            vkCmdBindVertexBuffers(cmd, kNoSkinBinding, 1, &no_skin_buffer_, &offset);
+            size_t run_begin = 0;
+            while (run_begin < instance_draws_.size()) {
+                const MeshBuffer* mesh = blockMesh(blocks_[instance_draws_[run_begin].id]);
+                size_t run_end = run_begin + 1;
+                while (run_end < instance_draws_.size() && blockMesh(blocks_[instance_draws_[run_end].id]) == mesh)
+                    ++run_end;
+                vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->buffer, &offset);
+                vkCmdBindIndexBuffer(cmd, mesh->index_buffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(cmd, mesh->index_count, static_cast<uint32_t>(run_end - run_begin), 0, 0,
+                                 static_cast<uint32_t>(run_begin));
+                run_begin = run_end;
+            }
         }
-        std::sort(draw_items.begin(), draw_items.end(),
-                  [](const DrawItem& a, const DrawItem& b) { return a.dist2 > b.dist2; });
 
-        for (size_t i = 0; i < draw_items.size(); ++i) {
-            const Block& block = blocks_[draw_items[i].index];
-            const float block_scale_mul = BlockScaleMultiplierPercent(block.scale_percent);
+        VkPipeline bound_pipeline = VK_NULL_HANDLE;
+        VkBuffer bound_vb = VK_NULL_HANDLE;
+        VkBuffer bound_ib = VK_NULL_HANDLE;
+        vkCmdBindVertexBuffers(cmd, kNoSkinBinding, 1, &no_skin_buffer_, &offset);
+        for (size_t i = 0; i < block_draws_.size(); ++i) {
+            const uint32_t block_index = block_draws_[i].id;
+            const Block& block = blocks_[block_index];
             VkBuffer vb = cube_buffer_;
             uint32_t vcount = cube_vertex_count_;
             MeshBuffer* mesh_ptr = nullptr;
@@ -1104,59 +1602,44 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
                 MeshBuffer& mesh = block_meshes_[block.mesh_index];
                 if (mesh.buffer && mesh.vertex_count > 0) {
                     vb = mesh.buffer;
-                    vcount = mesh.vertex_count;
+                    vcount = mesh.index_count;
                     mesh_ptr = &mesh;
                 }
             }
-            vkCmdBindVertexBuffers(cmd, 0, 1, &vb, &offset);
-            float draw_y = block.y;
-            if (mesh_ptr && mesh_ptr->is_skinned)
-                draw_y += (mesh_ptr->ground_offset_y - 0.5f) * block_scale_ * block_scale_mul;
-            Mat4 translate = mat4Translate(block.x, draw_y, block.z);
-            Mat4 rot_x = mat4RotateX(ToRadians(block.rot_x_deg));
-            float yaw_deg = block.rot_y_deg;
-            if (mesh_ptr && mesh_ptr->is_skinned)
-                yaw_deg += kSkinnedYawOffsetDeg;
-            Mat4 rot_y = mat4RotateY(ToRadians(yaw_deg));
-            Mat4 rot_z = mat4RotateZ(ToRadians(block.rot_z_deg));
-            // Apply yaw (Y) last so turning left/right doesn't change which face is up.
-            // With column vectors, the right-most rotation is applied first.
-            Mat4 rotate = mat4Multiply(rot_y, mat4Multiply(rot_x, rot_z));
-            Mat4 scale = mat4ScaleInternal(block_scale_ * block_scale_mul,
-                                           block_scale_ * block_scale_mul,
-                                           block_scale_ * block_scale_mul);
-            Mat4 model = mat4Multiply(translate, mat4Multiply(rotate, scale));
+            if (vb != bound_vb) {
+                vkCmdBindVertexBuffers(cmd, 0, 1, &vb, &offset);
+                bound_vb = vb;
+            }
+            if (mesh_ptr && mesh_ptr->index_buffer != bound_ib) {
+                vkCmdBindIndexBuffer(cmd, mesh_ptr->index_buffer, 0, VK_INDEX_TYPE_UINT32);
+                bound_ib = mesh_ptr->index_buffer;
+            }
+            const Mat4& model = block_models_[block_index];
             if (mesh_ptr && mesh_ptr->is_skinned) {
-                mesh_ptr->animation_time += dt;
-                const float cycle = (mesh_ptr->animation_duration > 0.001f) ? mesh_ptr->animation_duration : 1.0f;
-                if (mesh_ptr->animation_time > cycle)
-                    mesh_ptr->animation_time = std::fmod(mesh_ptr->animation_time, cycle);
-
-                // Main pass currently has no depth attachment; keep skinned mesh
+                // Without a depth attachment in the main pass, keep the skinned mesh
                 // visually stable by sorting triangles back-to-front per draw.
-                if (!mesh_ptr->cpu_vertices.empty() &&
-                    mesh_ptr->cpu_vertices.size() == static_cast<size_t>(vcount) &&
+                // cpu_positions/cpu_indices are only kept for that case.
+                if (!mesh_ptr->cpu_indices.empty() &&
+                    mesh_ptr->cpu_indices.size() == static_cast<size_t>(vcount) &&
                     (vcount % 3u) == 0u &&
-                    mesh_ptr->memory != VK_NULL_HANDLE) {
+                    mesh_ptr->index_memory.mapped != nullptr) {
                     const uint32_t tri_count = vcount / 3u;
+                    const std::vector<uint32_t>& indices = mesh_ptr->cpu_indices;
                     std::vector<uint32_t> tri_order(tri_count);
                     std::iota(tri_order.begin(), tri_order.end(), 0u);
 
-                    auto transform_point = [&](const Mat4& m, const float p[3], float out_p[3]) {
-                        out_p[0] = m.m[0] * p[0] + m.m[4] * p[1] + m.m[8] * p[2] + m.m[12];
-                        out_p[1] = m.m[1] * p[0] + m.m[5] * p[1] + m.m[9] * p[2] + m.m[13];
-                        out_p[2] = m.m[2] * p[0] + m.m[6] * p[1] + m.m[10] * p[2] + m.m[14];
-                    };
+                    // Each vertex is transformed once, not once per triangle using it.
+                    std::vector<float> world_positions(mesh_ptr->cpu_positions.size());
+                    math::Mat4TransformPoints(model.m,
+                                              mesh_ptr->cpu_positions.data(),
+                                              world_positions.data(),
+                                              world_positions.size() / 3u);
 
                     std::vector<float> tri_dist2(tri_count, 0.0f);
                     for (uint32_t ti = 0; ti < tri_count; ++ti) {
-                        const Vertex& a = mesh_ptr->cpu_vertices[ti * 3u + 0u];
-                        const Vertex& b = mesh_ptr->cpu_vertices[ti * 3u + 1u];
-                        const Vertex& c = mesh_ptr->cpu_vertices[ti * 3u + 2u];
-                        float wa[3], wb[3], wc[3];
-                        transform_point(model, a.pos, wa);
-                        transform_point(model, b.pos, wb);
-                        transform_point(model, c.pos, wc);
+                        const float* wa = &world_positions[indices[ti * 3u + 0u] * 3u];
+                        const float* wb = &world_positions[indices[ti * 3u + 1u] * 3u];
+                        const float* wc = &world_positions[indices[ti * 3u + 2u] * 3u];
                         const float cx = (wa[0] + wb[0] + wc[0]) / 3.0f;
                         const float cy = (wa[1] + wb[1] + wc[1]) / 3.0f;
                         const float cz = (wa[2] + wb[2] + wc[2]) / 3.0f;
@@ -1169,29 +1652,23 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
                     std::sort(tri_order.begin(), tri_order.end(),
                               [&](uint32_t lhs, uint32_t rhs) { return tri_dist2[lhs] > tri_dist2[rhs]; });
 
-                    std::vector<Vertex> sorted_vertices;
-                    sorted_vertices.reserve(mesh_ptr->cpu_vertices.size());
+                    // Only the 12-byte triangles move; the vertices stay put.
+                    uint32_t* sorted_indices = reinterpret_cast<uint32_t*>(mesh_ptr->index_memory.mapped);
                     for (uint32_t oi = 0; oi < tri_count; ++oi) {
                         const uint32_t src_tri = tri_order[oi];
-                        sorted_vertices.push_back(mesh_ptr->cpu_vertices[src_tri * 3u + 0u]);
-                        sorted_vertices.push_back(mesh_ptr->cpu_vertices[src_tri * 3u + 1u]);
-                        sorted_vertices.push_back(mesh_ptr->cpu_vertices[src_tri * 3u + 2u]);
-                    }
-
-                    void* mapped = nullptr;
-                    if (vkMapMemory(device_, mesh_ptr->memory, 0, sizeof(Vertex) * sorted_vertices.size(), 0, &mapped) == VK_SUCCESS) {
-                        std::memcpy(mapped, sorted_vertices.data(), sizeof(Vertex) * sorted_vertices.size());
-                        vkUnmapMemory(device_, mesh_ptr->memory);
+                        sorted_indices[oi * 3u + 0u] = indices[src_tri * 3u + 0u];
+                        sorted_indices[oi * 3u + 1u] = indices[src_tri * 3u + 1u];
+                        sorted_indices[oi * 3u + 2u] = indices[src_tri * 3u + 2u];
                     }
                 }
             }
             PushConstants pc = {};
-            pc.mvp = mat4Multiply(proj, mat4Multiply(view, model));
-            bool selected = (draw_items[i].index < selected_flags_.size() && selected_flags_[draw_items[i].index] != 0);
+            pc.mvp = mat4Multiply(view_proj, model);
+            bool selected = (selected_flags_[block_index] != 0);
             pc.tint[0] = selected ? 1.0f : 1.0f;
             pc.tint[1] = selected ? 1.0f : 1.0f;
             pc.tint[2] = selected ? 0.1f : 1.0f;
-            pc.tint[3] = (float)block.tex_index;
+            pc.tint[3] = (float)textureSlot(block.tex_index);
             pc.skin[0] = 0;
             pc.skin[1] = 0;
             pc.skin[2] = 0u;
@@ -1203,47 +1680,21 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
                 pc.skin[2] = 1u;
             }
 
-            if (mesh_ptr && mesh_ptr->is_skinned &&
-                mesh_ptr->joint_count > 0 &&
-                mesh_ptr->frame_count > 0 &&
-                !mesh_ptr->skin_palette.empty()) {
-                if (!skin_palette_is_mapped) {
-                    if (vkMapMemory(device_, skin_palette_memory_, 0, VK_WHOLE_SIZE, 0,
-                                    reinterpret_cast<void**>(&skin_palette_mapped)) == VK_SUCCESS) {
-                        skin_palette_is_mapped = true;
-                    }
-                }
-                if (skin_palette_is_mapped && skin_palette_mapped) {
-                    uint32_t frame_index = 0;
-                    if (mesh_ptr->frame_count > 1 && mesh_ptr->animation_duration > 0.0001f) {
-                        float phase = mesh_ptr->animation_time / mesh_ptr->animation_duration;
-                        if (phase < 0.0f)
-                            phase = 0.0f;
-                        phase = std::fmod(phase, 1.0f);
-                        frame_index = static_cast<uint32_t>(phase * (float)mesh_ptr->frame_count);
-                        if (frame_index >= mesh_ptr->frame_count)
-                            frame_index = mesh_ptr->frame_count - 1;
-                    }
-                    const uint32_t joints_to_copy = std::min(mesh_ptr->joint_count, kMaxSkinPaletteJoints);
-                    const size_t src_offset = (static_cast<size_t>(frame_index) * mesh_ptr->joint_count) * 16u;
-                    const uint32_t slot = std::min(skinned_draw_slot, kMaxSkinnedDrawsPerFrame - 1u);
-                    const uint32_t dst_joint_base = slot * kMaxSkinPaletteJoints;
-                    std::memcpy(skin_palette_mapped + static_cast<size_t>(dst_joint_base) * 16u,
-                                mesh_ptr->skin_palette.data() + src_offset,
-                                sizeof(float) * 16u * joints_to_copy);
-                    pc.skin[0] = dst_joint_base;
-                    pc.skin[1] = 1u;
-                    pc.skin[2] = 1u;
-                    if (skinned_draw_slot + 1u < kMaxSkinnedDrawsPerFrame)
-                        skinned_draw_slot += 1u;
-                }
+            if (skin_draw_base_[i] != kNoSkinPalette) {
+                pc.skin[0] = skin_draw_base_[i];
+                pc.skin[1] = 1u;
+                pc.skin[2] = 1u;
+            }
+            const VkPipeline draw_pipeline = blockPipeline(mesh_ptr);
+            if (draw_pipeline != bound_pipeline) {
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_pipeline);
+                bound_pipeline = draw_pipeline;
             }
-            VkPipeline draw_pipeline = (mesh_ptr && mesh_ptr->is_skinned && pipeline_skinned_ != VK_NULL_HANDLE)
-                                           ? pipeline_skinned_
-                                           : pipeline_;
-            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_pipeline);
             vkCmdPushConstants(cmd, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pc);
-            vkCmdDraw(cmd, vcount, 1, 0, 0);
+            if (mesh_ptr)
+                vkCmdDrawIndexed(cmd, vcount, 1, 0, 0, 0);
+            else
+                vkCmdDraw(cmd, vcount, 1, 0, 0);
         }
     } else {
         vkCmdBindVertexBuffers(cmd, 0, 1, &cube_buffer_, &offset);
@@ -1251,7 +1702,7 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
         Mat4 translate = mat4Translate(0.0f, 0.5f, 0.0f);
         Mat4 model = mat4Multiply(translate, scale);
         PushConstants pc = {};
-        pc.mvp = mat4Multiply(proj, mat4Multiply(view, model));
+        pc.mvp = mat4Multiply(view_proj, model);
         pc.tint[0] = 1.0f;
         pc.tint[1] = 1.0f;
         pc.tint[2] = 1.0f;
@@ -1264,9 +1715,6 @@ void VoxelRenderer::render(VkCommandBuffer cmd, int width, int height) {
         vkCmdPushConstants(cmd, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pc);
         vkCmdDraw(cmd, cube_vertex_count_, 1, 0, 0);
     }
-
-    if (skin_palette_is_mapped)
-        vkUnmapMemory(device_, skin_palette_memory_);
 }
 
 void VoxelRenderer::setCamera(float x, float y, float z, float yaw_radians, float pitch_radians) {
@@ -1277,121 +1725,849 @@ void VoxelRenderer::setCamera(float x, float y, float z, float yaw_radians, floa
     camera_pitch_ = pitch_radians;
 }
 
+uint32_t VoxelRenderer::textureSlot(int tex_index) const {
+    if (tex_index < 0 || (size_t)tex_index >= texture_slots_.size())
+        return 0;
+    return texture_slots_[tex_index];
+}
+
+const VoxelRenderer::MeshBuffer* VoxelRenderer::blockMesh(const Block& block) const {
+    if (block.mesh_index < 0 || (size_t)block.mesh_index >= block_meshes_.size())
+        return nullptr;
+    const MeshBuffer& mesh = block_meshes_[block.mesh_index];
+    return (mesh.buffer && mesh.vertex_count > 0) ? &mesh : nullptr;
+}
+
+VkPipeline VoxelRenderer::blockPipeline(const MeshBuffer* mesh) const {
+    if (!mesh)
+        return pipeline_;
+    if (mesh->layout == kVertexLayoutStatic)
+        return pipeline_compact_;
+    if (mesh->layout == kVertexLayoutSkinned)
+        return pipeline_skinned_compact_;
+    return (mesh->is_skinned && pipeline_skinned_ != VK_NULL_HANDLE) ? pipeline_skinned_ : pipeline_;
+}
+
+static void ExpandTransformedBox(const VoxelRenderer::Mat4& m, const float lo[3], const float hi[3], VoxelAabb* box) {
+    // Centre/extent form: the world extent along each axis is |M| * local extent.
+    for (int row = 0; row < 3; ++row) {
+        float center = m.m[12 + row];
+        float extent = 0.0f;
+        for (int col = 0; col < 3; ++col) {
+            const float c = 0.5f * (lo[col] + hi[col]);
+            const float e = 0.5f * (hi[col] - lo[col]);
+            center += m.m[col * 4 + row] * c;
+            extent += std::fabs(m.m[col * 4 + row]) * e;
+        }
+        box->min[row] = std::min(box->min[row], center - extent);
+        box->max[row] = std::max(box->max[row], center + extent);
+    }
+}
+
+VoxelAabb VoxelRenderer::blockBounds(size_t index) const {
+    const Block& block = blocks_[index];
+    static const float kCubeMin[3] = {-0.5f, -0.5f, -0.5f};
+    static const float kCubeMax[3] = {0.5f, 0.5f, 0.5f};
+    const float origin[3] = {block.x, block.y, block.z};
+    VoxelAabb box;
+    for (int axis = 0; axis < 3; ++axis) {
+        box.min[axis] = origin[axis];
+        box.max[axis] = origin[axis];
+    }
+    const MeshBuffer* mesh = blockMesh(block);
+    // The pick pass always draws the plain cube, so it is always covered.
+    if (mesh && mesh->is_skinned)
+        ExpandTransformedBox(blockModelMatrix(block, nullptr), kCubeMin, kCubeMax, &box);
+    else
+        ExpandTransformedBox(block_models_[index], kCubeMin, kCubeMax, &box);
+    if (mesh) {
+        float lo[3];
+        float hi[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            lo[axis] = mesh->bounds_min[axis];
+            hi[axis] = mesh->bounds_max[axis];
+            if (mesh->is_skinned) {
+                // Animated poses leave the bind-pose box; pad it generously.
+                const float pad = 0.5f * (hi[axis] - lo[axis]);
+                lo[axis] -= pad;
+                hi[axis] += pad;
+            }
+        }
+        ExpandTransformedBox(block_models_[index], lo, hi, &box);
+    }
+    return box;
+}
+
+VoxelRenderer::Mat4 VoxelRenderer::blockModelMatrix(const Block& block, const MeshBuffer* mesh) const {
+    const bool skinned = (mesh && mesh->is_skinned);
+    const float block_scale_mul = BlockScaleMultiplierPercent(block.scale_percent);
+    float draw_y = block.y;
+    if (skinned)
+        draw_y += (mesh->ground_offset_y - 0.5f) * block_scale_ * block_scale_mul;
+    Mat4 translate = mat4Translate(block.x, draw_y, block.z);
+    Mat4 rot_x = mat4RotateX(ToRadians(block.rot_x_deg));
+    float yaw_deg = block.rot_y_deg;
+    if (skinned)
+        yaw_deg += kSkinnedYawOffsetDeg;
+    Mat4 rot_y = mat4RotateY(ToRadians(yaw_deg));
+    Mat4 rot_z = mat4RotateZ(ToRadians(block.rot_z_deg));
+    // Apply yaw (Y) last so turning left/right doesn't change which face is up.
+    // With column vectors, the right-most rotation is applied first.
+    Mat4 rotate = mat4Multiply(rot_y, mat4Multiply(rot_x, rot_z));
+    Mat4 scale = mat4ScaleInternal(block_scale_ * block_scale_mul,
+                                   block_scale_ * block_scale_mul,
+                                   block_scale_ * block_scale_mul);
+    return mat4Multiply(translate, mat4Multiply(rotate, scale));
+}
+
+bool VoxelRenderer::ensureInstanceCapacity(InstanceBuffer* instances, size_t count) {
+    if (instances->buffer && instances->capacity >= count)
+        return true;
+    size_t capacity = std::max<size_t>(instances->capacity * 2, 256);
+    while (capacity < count)
+        capacity *= 2;
+    retireBuffer(instances->buffer, instances->memory);
+    *instances = InstanceBuffer();
+    if (!createBuffer(sizeof(InstanceData) * capacity,
+                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      &instances->buffer,
+                      &instances->memory)) {
+        std::fprintf(stderr, "renderer: instance buffer allocation failed (%zu instances)\n", capacity);
+        retireBuffer(instances->buffer, instances->memory);
+        *instances = InstanceBuffer();
+        return false;
+    }
+    instances->mapped = reinterpret_cast<InstanceData*>(instances->memory.mapped);
+    instances->capacity = capacity;
+    return true;
+}
+
+bool VoxelRenderer::ensureSkinPaletteCapacity(uint32_t joint_count) {
+    if (skin_palette_buffer_ && skin_palette_capacity_ >= joint_count)
+        return true;
+    // Doubles past joint_count plus half again, so a crowd that keeps growing
+    // does not replace the descriptor set on consecutive frames.
+    const uint32_t target = joint_count + joint_count / 2u;
+    uint32_t capacity = std::max(skin_palette_capacity_ * 2u, kInitialSkinPaletteJoints);
+    while (capacity < target)
+        capacity *= 2u;
+    const VkDeviceSize region = sizeof(float) * 16u * capacity;
+    const VkDeviceSize stride = ((region + skin_palette_align_ - 1) / skin_palette_align_) * skin_palette_align_;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VoxelGpuAllocation memory;
+    if (!createBuffer(stride * frames_in_flight_,
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      &buffer,
+                      &memory)) {
+        std::fprintf(stderr, "renderer: skin palette allocation failed (%u joints per frame)\n", capacity);
+        retireBuffer(buffer, memory);
+        return false;
+    }
+
+    const VkBuffer old_buffer = skin_palette_buffer_;
+    const VoxelGpuAllocation old_memory = skin_palette_memory_;
+    const uint32_t old_capacity = skin_palette_capacity_;
+    const VkDeviceSize old_stride = skin_palette_stride_;
+    skin_palette_buffer_ = buffer;
+    skin_palette_memory_ = memory;
+    skin_palette_capacity_ = capacity;
+    skin_palette_stride_ = stride;
+
+    // Frames in flight may still read the current set, so it is replaced
+    // instead of updated. During init() the set does not exist yet.
+    if (descriptor_set_ != VK_NULL_HANDLE) {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        if (!allocateDescriptorSet(&set)) {
+            skin_palette_buffer_ = old_buffer;
+            skin_palette_memory_ = old_memory;
+            skin_palette_capacity_ = old_capacity;
+            skin_palette_stride_ = old_stride;
+            retireBuffer(buffer, memory);
+            return false;
+        }
+        retireDescriptorSet(descriptor_set_);
+        descriptor_set_ = set;
+    }
+    retireBuffer(old_buffer, old_memory);
+    return true;
+}
+
+bool VoxelRenderer::allocateDescriptorSet(VkDescriptorSet* out_set) {
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &descriptor_set_layout_;
+    if (vkAllocateDescriptorSets(device_, &alloc_info, out_set) != VK_SUCCESS) {
+        std::fprintf(stderr, "renderer: descriptor set allocation failed\n");
+        *out_set = VK_NULL_HANDLE;
+        return false;
+    }
+
+    std::vector<VkDescriptorImageInfo> image_infos(1 + block_texture_count_);
+    image_infos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_infos[0].imageView = ground_texture_view_;
+    image_infos[0].sampler = texture_sampler_;
+    for (uint32_t i = 0; i < block_texture_count_; ++i) {
+        const BlockTexture& tex = (i < block_textures_.size()) ? block_textures_[i] : block_textures_[0];
+        image_infos[1 + i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_infos[1 + i].imageView = tex.view;
+        image_infos[1 + i].sampler = texture_sampler_;
+    }
+
+    // Bindings 2 and 3 cover one frame's region; render() selects the
+    // region with dynamic offsets.
+    VkDescriptorBufferInfo skin_info = {};
+    skin_info.buffer = skin_palette_buffer_;
+    skin_info.offset = 0;
+    skin_info.range = skin_palette_stride_;
+
+    VkDescriptorBufferInfo view_proj_info = {};
+    view_proj_info.buffer = view_proj_buffer_;
+    view_proj_info.offset = 0;
+    view_proj_info.range = sizeof(Mat4);
+
+    VkWriteDescriptorSet writes[4] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = *out_set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].descriptorCount = 1;
+    writes[0].pImageInfo = &image_infos[0];
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = *out_set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[1].descriptorCount = block_texture_count_;
+    writes[1].pImageInfo = &image_infos[1];
+    writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[2].dstSet = *out_set;
+    writes[2].dstBinding = 2;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    writes[2].descriptorCount = 1;
+    writes[2].pBufferInfo = &skin_info;
+    writes[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[3].dstSet = *out_set;
+    writes[3].dstBinding = 3;
+    writes[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    writes[3].descriptorCount = 1;
+    writes[3].pBufferInfo = &view_proj_info;
+    vkUpdateDescriptorSets(device_, 4, writes, 0, nullptr);
+    return true;
+}
+
+void VoxelRenderer::bindDescriptorSet(VkCommandBuffer cmd, uint32_t frame_slot) {
+    // Dynamic offsets are consumed in binding order: skin palette, then view-projection.
+    const uint32_t dynamic_offsets[2] = {
+        static_cast<uint32_t>(skin_palette_stride_ * frame_slot),
+        static_cast<uint32_t>(view_proj_stride_ * frame_slot),
+    };
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &descriptor_set_, 2, dynamic_offsets);
+}
+
 void VoxelRenderer::setBlocks(const std::vector<Block>& blocks, float block_size) {
-    blocks_ = blocks;
+    for (size_t i = 0; i < block_handles_.size(); ++i)
+        releaseBlockHandle(block_handles_[i]);
+    block_handles_.clear();
+    blocks_.clear();
+    selected_flags_.clear();
+    block_in_chunk_.clear();
+    block_cell_.clear();
+    block_proxy_.clear();
+    block_models_.clear();
+    block_animation_.clear();
+    block_tree_.clear();
     block_scale_ = block_size;
-    selected_flags_.assign(blocks_.size(), 0);
+    chunk_grid_.reset(block_scale_);
+
+    blocks_.reserve(blocks.size());
+    selected_flags_.reserve(blocks.size());
+    block_handles_.reserve(blocks.size());
+    block_in_chunk_.reserve(blocks.size());
+    block_cell_.reserve(blocks.size() * 3);
+    block_proxy_.reserve(blocks.size());
+    block_models_.reserve(blocks.size());
+    block_animation_.reserve(blocks.size());
+    size_t dropped = 0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (!appendBlockState(blocks[i]))
+            dropped += 1;
+    }
+    if (dropped > 0)
+        std::fprintf(stderr, "renderer: %zu block(s) dropped, no block handles left\n", dropped);
 }
 
 void VoxelRenderer::setSelection(const std::vector<unsigned char>& selected_flags) {
-    selected_flags_ = selected_flags;
+    for (size_t i = 0; i < blocks_.size(); ++i)
+        setSelectedFlag(i, i < selected_flags.size() && selected_flags[i] != 0);
 }
 
-void VoxelRenderer::setBlockMeshes(const std::vector<MeshData>& meshes) {
-    for (size_t i = 0; i < block_meshes_.size(); ++i) {
-        if (block_meshes_[i].buffer)
-            vkDestroyBuffer(device_, block_meshes_[i].buffer, nullptr);
-        if (block_meshes_[i].memory)
-            vkFreeMemory(device_, block_meshes_[i].memory, nullptr);
+std::vector<VoxelRenderer::BlockHandle> VoxelRenderer::addBlocks(const std::vector<Block>& blocks) {
+    std::vector<BlockHandle> handles;
+    handles.reserve(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        handles.push_back(appendBlockState(blocks[i]) ? block_handles_.back() : kInvalidBlockHandle);
+    return handles;
+}
+
+void VoxelRenderer::removeBlocks(const std::vector<BlockHandle>& handles) {
+    for (size_t i = 0; i < handles.size(); ++i) {
+        const int index = blockIndex(handles[i]);
+        if (index >= 0)
+            eraseBlock(static_cast<size_t>(index));
+    }
+}
+
+bool VoxelRenderer::updateBlock(BlockHandle handle, const Block& block) {
+    const int index = blockIndex(handle);
+    if (index < 0)
+        return false;
+    detachBlockState(static_cast<size_t>(index));
+    if (blocks_[index].mesh_index != block.mesh_index) {
+        block_animation_[index] = AnimationState();
+        block_animation_[index].time = block.animation_offset;
+    }
+    blocks_[index] = block;
+    attachBlockState(static_cast<size_t>(index));
+    return true;
+}
+
+bool VoxelRenderer::setBlockAnimation(BlockHandle handle, const AnimationState& state) {
+    const int index = blockIndex(handle);
+    if (index < 0)
+        return false;
+    block_animation_[index] = state;
+    return true;
+}
+
+bool VoxelRenderer::blockAnimation(BlockHandle handle, AnimationState* out_state) const {
+    const int index = blockIndex(handle);
+    if (index < 0 || !out_state)
+        return false;
+    *out_state = block_animation_[index];
+    return true;
+}
+
+void VoxelRenderer::setSkinPoseTimeQuantum(float seconds) {
+    skin_pose_time_quantum_ = std::max(seconds, 0.0f);
+}
+
+void VoxelRenderer::evaluateSkinPoses(float* palette_region) {
+    // Each pose writes its own joint range. Jobs are runs of consecutive
+    // (time-sorted) poses so the keyframe cursors stay warm; small crowds
+    // make a single job and stay on the render thread.
+    const size_t pose_count = skin_poses_.size();
+    const size_t job_count = (pose_count + kSkinPosesPerWorker - 1) / kSkinPosesPerWorker;
+    std::vector<GltfPoseScratch> scratch(job_count > 1 ? worker_pool_.threadCount() : 1u);
+    worker_pool_.run(job_count, [this, palette_region, pose_count, &scratch](size_t job, unsigned int worker) {
+        const size_t end = std::min(pose_count, (job + 1) * kSkinPosesPerWorker);
+        for (size_t p = job * kSkinPosesPerWorker; p < end; ++p) {
+            const SkinPose& pose = skin_poses_[p];
+            EvaluateGltfPose(*block_meshes_[pose.mesh].skeleton, pose.clip, pose.time, &scratch[worker],
+                             palette_region + static_cast<size_t>(pose.joint_base) * 16u);
+        }
+    });
+}
+
+void VoxelRenderer::updateAnimations(float dt) {
+    // States only read their own mesh, so blocks can be advanced in any
+    // order (or split across workers) without affecting draw recording.
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        const MeshBuffer* mesh = blockMesh(blocks_[i]);
+        if (mesh && mesh->is_skinned)
+            AdvanceAnimation(&block_animation_[i], dt, mesh->skeleton ? ClipDuration(*mesh->skeleton, block_animation_[i].clip) : 0.0f);
+    }
+}
+
+bool VoxelRenderer::setBlockSelected(BlockHandle handle, bool selected) {
+    const int index = blockIndex(handle);
+    if (index < 0)
+        return false;
+    setSelectedFlag(static_cast<size_t>(index), selected);
+    return true;
+}
+
+void VoxelRenderer::setSelectedFlag(size_t index, bool selected) {
+    if ((selected_flags_[index] != 0) == selected)
+        return;
+    // Selected blocks need their own tint, so they leave the chunk meshes
+    // while selected and are drawn on the per-block path instead.
+    removeBlockFromChunks(index);
+    selected_flags_[index] = selected ? 1 : 0;
+    if (isChunkCandidate(index))
+        addBlockToChunks(index);
+}
+
+static const uint32_t kBlockHandleSlotBits = 32;
+static const uint64_t kBlockHandleSlotMask = 0xFFFFFFFFull;
+static const uint32_t kMaxHandleGeneration = 0xFFFFFFFFu;
+
+int VoxelRenderer::blockIndex(BlockHandle handle) const {
+    const uint64_t slot_plus_one = handle & kBlockHandleSlotMask;
+    if (slot_plus_one == 0 || slot_plus_one > handle_slots_.size())
+        return -1;
+    const HandleSlot& slot = handle_slots_[slot_plus_one - 1];
+    if (!slot.live || slot.generation != (uint32_t)(handle >> kBlockHandleSlotBits))
+        return -1;
+    return static_cast<int>(slot.index);
+}
+
+VoxelRenderer::BlockHandle VoxelRenderer::blockHandle(size_t index) const {
+    return (index < block_handles_.size()) ? block_handles_[index] : kInvalidBlockHandle;
+}
+
+VoxelRenderer::BlockHandle VoxelRenderer::allocateBlockHandle(uint32_t index) {
+    uint32_t slot_index = 0;
+    if (!free_handle_slots_.empty()) {
+        slot_index = free_handle_slots_.back();
+        free_handle_slots_.pop_back();
+    } else {
+        if (handle_slots_.size() >= kBlockHandleSlotMask)
+            return kInvalidBlockHandle;
+        slot_index = static_cast<uint32_t>(handle_slots_.size());
+        handle_slots_.push_back(HandleSlot());
+    }
+    HandleSlot& slot = handle_slots_[slot_index];
+    slot.index = index;
+    slot.live = true;
+    return ((BlockHandle)slot.generation << kBlockHandleSlotBits) | (BlockHandle)(slot_index + 1u);
+}
+
+void VoxelRenderer::releaseBlockHandle(BlockHandle handle) {
+    const uint64_t slot_plus_one = handle & kBlockHandleSlotMask;
+    if (slot_plus_one == 0 || slot_plus_one > handle_slots_.size())
+        return;
+    HandleSlot& slot = handle_slots_[slot_plus_one - 1];
+    if (!slot.live)
+        return;
+    slot.live = false;
+    // Stale handles to a reused slot must not resolve to the new block, so
+    // a slot whose generation would wrap is retired instead of reused.
+    if (slot.generation == kMaxHandleGeneration)
+        return;
+    slot.generation += 1u;
+    free_handle_slots_.push_back(static_cast<uint32_t>(slot_plus_one - 1));
+}
+
+bool VoxelRenderer::appendBlockState(const Block& block) {
+    const size_t index = blocks_.size();
+    const BlockHandle handle = allocateBlockHandle(static_cast<uint32_t>(index));
+    if (handle == kInvalidBlockHandle)
+        return false;
+    blocks_.push_back(block);
+    selected_flags_.push_back(0);
+    block_handles_.push_back(handle);
+    block_in_chunk_.push_back(0);
+    block_cell_.push_back(0);
+    block_cell_.push_back(0);
+    block_cell_.push_back(0);
+    block_proxy_.push_back(VoxelAabbTree::kNullNode);
+    block_models_.push_back(Mat4());
+    block_animation_.push_back(AnimationState());
+    block_animation_.back().time = block.animation_offset;
+    attachBlockState(index);
+    return true;
+}
+
+void VoxelRenderer::attachBlockState(size_t index) {
+    block_models_[index] = blockModelMatrix(blocks_[index], blockMesh(blocks_[index]));
+    block_proxy_[index] = block_tree_.insert(blockBounds(index), static_cast<uint32_t>(index));
+    if (isChunkCandidate(index))
+        addBlockToChunks(index);
+}
+
+void VoxelRenderer::detachBlockState(size_t index) {
+    removeBlockFromChunks(index);
+    block_tree_.remove(block_proxy_[index]);
+    block_proxy_[index] = VoxelAabbTree::kNullNode;
+}
+
+void VoxelRenderer::eraseBlock(size_t index) {
+    detachBlockState(index);
+    releaseBlockHandle(block_handles_[index]);
+    const size_t last = blocks_.size() - 1;
+    if (index != last) {
+        // Swap-remove keeps the arrays dense; only the moved block's handle
+        // needs to learn its new index.
+        blocks_[index] = blocks_[last];
+        selected_flags_[index] = selected_flags_[last];
+        block_handles_[index] = block_handles_[last];
+        block_in_chunk_[index] = block_in_chunk_[last];
+        block_cell_[index * 3 + 0] = block_cell_[last * 3 + 0];
+        block_cell_[index * 3 + 1] = block_cell_[last * 3 + 1];
+        block_cell_[index * 3 + 2] = block_cell_[last * 3 + 2];
+        block_proxy_[index] = block_proxy_[last];
+        block_models_[index] = block_models_[last];
+        block_animation_[index] = block_animation_[last];
+        block_tree_.setUserData(block_proxy_[index], static_cast<uint32_t>(index));
+        const uint64_t slot_plus_one = block_handles_[index] & kBlockHandleSlotMask;
+        if (slot_plus_one > 0 && slot_plus_one <= handle_slots_.size())
+            handle_slots_[slot_plus_one - 1].index = static_cast<uint32_t>(index);
+    }
+    blocks_.pop_back();
+    selected_flags_.pop_back();
+    block_handles_.pop_back();
+    block_in_chunk_.pop_back();
+    block_cell_.resize(blocks_.size() * 3);
+    block_proxy_.pop_back();
+    block_models_.pop_back();
+    block_animation_.pop_back();
+}
+
+bool VoxelRenderer::isChunkCandidate(size_t index) const {
+    if (!main_pass_has_depth_ || index >= blocks_.size())
+        return false;
+    const Block& block = blocks_[index];
+    if (block.mesh_index >= 0)
+        return false;
+    if (selected_flags_[index] != 0)
+        return false;
+    if (block.rot_x_deg != 0.0f || block.rot_y_deg != 0.0f || block.rot_z_deg != 0.0f)
+        return false;
+    return BlockScaleMultiplierPercent(block.scale_percent) == 1.0f;
+}
+
+void VoxelRenderer::addBlockToChunks(size_t index) {
+    if (block_in_chunk_[index])
+        return;
+    const Block& block = blocks_[index];
+    int cell[3] = {0, 0, 0};
+    if (!chunk_grid_.cellForPosition(block.x, block.y, block.z, &cell[0], &cell[1], &cell[2]))
+        return;
+    // Overlapping blocks keep the per-block path; only one can own the cell.
+    if (!chunk_grid_.insertCell(cell[0], cell[1], cell[2], block.tex_index))
+        return;
+    block_in_chunk_[index] = 1;
+    block_cell_[index * 3 + 0] = cell[0];
+    block_cell_[index * 3 + 1] = cell[1];
+    block_cell_[index * 3 + 2] = cell[2];
+}
+
+void VoxelRenderer::removeBlockFromChunks(size_t index) {
+    if (!block_in_chunk_[index])
+        return;
+    chunk_grid_.removeCell(block_cell_[index * 3 + 0], block_cell_[index * 3 + 1], block_cell_[index * 3 + 2]);
+    block_in_chunk_[index] = 0;
+}
+
+void VoxelRenderer::updateChunkBuffers() {
+    const std::set<ChunkKey>& dirty = chunk_grid_.dirtyChunks();
+    if (dirty.empty())
+        return;
+    std::vector<VoxelChunkGrid::Section> sections;
+    std::vector<Vertex> verts;
+    for (std::set<ChunkKey>::const_iterator key_it = dirty.begin(); key_it != dirty.end(); ++key_it) {
+        std::map<ChunkKey, ChunkBuffer>::iterator old_it = chunk_buffers_.find(*key_it);
+        if (old_it != chunk_buffers_.end()) {
+            for (size_t s = 0; s < old_it->second.sections.size(); ++s)
+                retireBuffer(old_it->second.sections[s].buffer, old_it->second.sections[s].memory);
+            chunk_buffers_.erase(old_it);
+        }
+        if (!chunk_grid_.hasChunk(*key_it))
+            continue;
+
+        chunk_grid_.buildChunkMesh(*key_it, &sections);
+        ChunkBuffer chunk;
+        chunk_grid_.chunkBounds(*key_it, chunk.bounds.min, chunk.bounds.max);
+        for (size_t s = 0; s < sections.size(); ++s) {
+            const VoxelChunkGrid::Section& src = sections[s];
+            const size_t count = src.positions.size() / 3;
+            if (count == 0)
+                continue;
+            verts.resize(count);
+            for (size_t v = 0; v < count; ++v) {
+                Vertex& dst = verts[v];
+                dst.pos[0] = src.positions[v * 3 + 0];
+                dst.pos[1] = src.positions[v * 3 + 1];
+                dst.pos[2] = src.positions[v * 3 + 2];
+                dst.color[0] = 0.7f;
+                dst.color[1] = 0.7f;
+                dst.color[2] = 0.7f;
+                dst.normal[0] = src.normals[v * 3 + 0];
+                dst.normal[1] = src.normals[v * 3 + 1];
+                dst.normal[2] = src.normals[v * 3 + 2];
+                dst.uv[0] = src.uvs[v * 2 + 0];
+                dst.uv[1] = src.uvs[v * 2 + 1];
+                dst.joints[0] = dst.joints[1] = dst.joints[2] = dst.joints[3] = 0;
+                dst.weights[0] = 1.0f;
+                dst.weights[1] = dst.weights[2] = dst.weights[3] = 0.0f;
+            }
+            ChunkSection section;
+            section.tex_index = src.tex_index;
+            if (!createVertexBuffer(verts.data(), sizeof(Vertex) * verts.size(), &section.buffer, &section.memory))
+                continue;
+            section.vertex_count = (uint32_t)verts.size();
+            chunk.sections.push_back(section);
+        }
+        if (!chunk.sections.empty())
+            chunk_buffers_[*key_it] = chunk;
+    }
+    chunk_grid_.clearDirty();
+}
+
+void VoxelRenderer::retireBuffer(VkBuffer buffer, const VoxelGpuAllocation& memory) {
+    if (!buffer && !memory.valid())
+        return;
+    RetiredBuffer retired;
+    retired.buffer = buffer;
+    retired.memory = memory;
+    retired.retire_frame = frame_index_;
+    retired_buffers_.push_back(retired);
+}
+
+void VoxelRenderer::retireDescriptorSet(VkDescriptorSet set) {
+    if (!set)
+        return;
+    RetiredDescriptorSet retired;
+    retired.set = set;
+    retired.retire_frame = frame_index_;
+    retired_descriptor_sets_.push_back(retired);
+}
+
+void VoxelRenderer::releaseRetiredBuffers(bool force) {
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_buffers_.size(); ++i) {
+        const RetiredBuffer& retired = retired_buffers_[i];
+        // The frame that last referenced the buffer may still be in flight.
+        if (!force && retired.retire_frame + frames_in_flight_ > frame_index_) {
+            retired_buffers_[kept++] = retired;
+            continue;
+        }
+        if (retired.buffer)
+            vkDestroyBuffer(device_, retired.buffer, nullptr);
+        VoxelGpuAllocation memory = retired.memory;
+        gpu_allocator_.free(&memory);
+    }
+    retired_buffers_.resize(kept);
+
+    kept = 0;
+    for (size_t i = 0; i < retired_descriptor_sets_.size(); ++i) {
+        const RetiredDescriptorSet& retired = retired_descriptor_sets_[i];
+        if (!force && retired.retire_frame + frames_in_flight_ > frame_index_) {
+            retired_descriptor_sets_[kept++] = retired;
+            continue;
+        }
+        vkFreeDescriptorSets(device_, descriptor_pool_, 1, &retired.set);
     }
+    retired_descriptor_sets_.resize(kept);
+}
+
+// Limits for the half-float fields of the compact layouts; at 16 the
+// position step is 1/128 of a block.
+static const float kMaxCompactPosition = 16.0f;
+static const float kMaxCompactUv = 8.0f;
+
+static uint8_t PackUnorm8(float value) {
+    return (uint8_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static int8_t PackSnorm8(float value) {
+    return (int8_t)std::floor(std::min(std::max(value, -1.0f), 1.0f) * 127.0f + 0.5f);
+}
+
+// Attributes of one MeshData vertex, with the defaults used for streams
+// that are missing or too short.
+struct MeshSurface {
+    float normal[3];
+    float uv[2];
+    float color[3];
+    uint32_t joints[4];
+    float weights[4];
+};
+
+static void ReadMeshSurface(const VoxelRenderer::MeshData& mesh, size_t v, MeshSurface* out) {
+    static const MeshSurface kDefaults = {{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0, 0, 0, 0}, {1.0f, 0.0f, 0.0f, 0.0f}};
+    *out = kDefaults;
+    if (mesh.normals.size() >= (v + 1) * 3)
+        std::memcpy(out->normal, &mesh.normals[v * 3], sizeof(out->normal));
+    if (mesh.uvs.size() >= (v + 1) * 2)
+        std::memcpy(out->uv, &mesh.uvs[v * 2], sizeof(out->uv));
+    if (mesh.colors.size() >= (v + 1) * 4)
+        std::memcpy(out->color, &mesh.colors[v * 4], sizeof(out->color));
+    if (mesh.joints.size() >= (v + 1) * 4)
+        std::memcpy(out->joints, &mesh.joints[v * 4], sizeof(out->joints));
+    if (mesh.weights.size() >= (v + 1) * 4)
+        std::memcpy(out->weights, &mesh.weights[v * 4], sizeof(out->weights));
+}
+
+static void PackSurface(const MeshSurface& surface, int8_t out_normal[4], uint16_t out_uv[2], uint8_t out_color[4]) {
+    for (int c = 0; c < 3; ++c) {
+        out_normal[c] = PackSnorm8(surface.normal[c]);
+        out_color[c] = PackUnorm8(surface.color[c]);
+    }
+    out_normal[3] = 0;
+    out_color[3] = 255;
+    out_uv[0] = math::FloatToHalf(surface.uv[0]);
+    out_uv[1] = math::FloatToHalf(surface.uv[1]);
+}
+
+// Quantizes skin weights so they still sum to exactly 255; the rounding
+// error goes to the largest weight.
+static void PackWeights(const float weights[4], uint8_t out[4]) {
+    const float sum = weights[0] + weights[1] + weights[2] + weights[3];
+    if (!(sum > 1e-6f)) {
+        out[0] = 255;
+        out[1] = out[2] = out[3] = 0;
+        return;
+    }
+    int total = 0;
+    int largest = 0;
+    for (int c = 0; c < 4; ++c) {
+        out[c] = PackUnorm8(weights[c] / sum);
+        total += out[c];
+        if (out[c] > out[largest])
+            largest = c;
+    }
+    out[largest] = (uint8_t)(out[largest] + (255 - total));
+}
+
+void VoxelRenderer::setBlockMeshes(const std::vector<MeshData>& meshes) {
+    for (size_t i = 0; i < block_meshes_.size(); ++i)
+        retireMeshBuffer(&block_meshes_[i]);
     block_meshes_.clear();
 
     block_meshes_.resize(meshes.size());
+    // Meshes split out of one model share its skeleton.
+    std::map<std::string, std::shared_ptr<const GltfSkeleton> > skeletons;
     for (size_t i = 0; i < meshes.size(); ++i) {
         const MeshData& mesh = meshes[i];
         size_t count = mesh.positions.size() / 3;
         if (count == 0)
             continue;
 
-        std::vector<Vertex> verts;
-        verts.resize(count);
-        for (size_t v = 0; v < count; ++v) {
-            verts[v].pos[0] = mesh.positions[v * 3 + 0];
-            verts[v].pos[1] = mesh.positions[v * 3 + 1];
-            verts[v].pos[2] = mesh.positions[v * 3 + 2];
-            if (mesh.normals.size() >= (v + 1) * 3) {
-                verts[v].normal[0] = mesh.normals[v * 3 + 0];
-                verts[v].normal[1] = mesh.normals[v * 3 + 1];
-                verts[v].normal[2] = mesh.normals[v * 3 + 2];
-            } else {
-                verts[v].normal[0] = 0.0f;
-                verts[v].normal[1] = 1.0f;
-                verts[v].normal[2] = 0.0f;
+        const std::vector<uint32_t>* indices = &mesh.indices;
+        std::vector<uint32_t> sequential;
+        if (mesh.indices.empty()) {
+            sequential.resize(count);
+            std::iota(sequential.begin(), sequential.end(), 0u);
+            indices = &sequential;
+        }
+        bool indices_ok = true;
+        for (size_t n = 0; n < indices->size() && indices_ok; ++n) {
+            if ((*indices)[n] >= count) {
+                std::fprintf(stderr, "renderer: mesh[%zu] index %u out of range (%zu vertices)\n", i, (*indices)[n], count);
+                indices_ok = false;
             }
-            if (mesh.uvs.size() >= (v + 1) * 2) {
-                verts[v].uv[0] = mesh.uvs[v * 2 + 0];
-                verts[v].uv[1] = mesh.uvs[v * 2 + 1];
-            } else {
-                verts[v].uv[0] = 0.0f;
-                verts[v].uv[1] = 0.0f;
+        }
+        if (!indices_ok)
+            continue;
+
+        // Compact layouts unless half floats can't hold the positions or UVs
+        // (static) or a joint index doesn't fit a byte (skinned).
+        VertexLayout layout = mesh.is_skinned ? kVertexLayoutSkinned : kVertexLayoutStatic;
+        for (size_t n = 0; n < mesh.uvs.size() && layout != kVertexLayoutFull; ++n) {
+            if (!(std::fabs(mesh.uvs[n]) <= kMaxCompactUv))
+                layout = kVertexLayoutFull;
+        }
+        if (layout == kVertexLayoutStatic) {
+            for (size_t n = 0; n < count * 3 && layout != kVertexLayoutFull; ++n) {
+                if (!(std::fabs(mesh.positions[n]) <= kMaxCompactPosition))
+                    layout = kVertexLayoutFull;
             }
-            if (mesh.colors.size() >= (v + 1) * 4) {
-                verts[v].color[0] = mesh.colors[v * 4 + 0];
-                verts[v].color[1] = mesh.colors[v * 4 + 1];
-                verts[v].color[2] = mesh.colors[v * 4 + 2];
-            } else {
-                verts[v].color[0] = 1.0f;
-                verts[v].color[1] = 1.0f;
-                verts[v].color[2] = 1.0f;
+        } else if (layout == kVertexLayoutSkinned) {
+            for (size_t n = 0; n < mesh.joints.size() && layout != kVertexLayoutFull; ++n) {
+                if (mesh.joints[n] > 255u)
+                    layout = kVertexLayoutFull;
             }
-            if (mesh.joints.size() >= (v + 1) * 4) {
-                verts[v].joints[0] = mesh.joints[v * 4 + 0];
-                verts[v].joints[1] = mesh.joints[v * 4 + 1];
-                verts[v].joints[2] = mesh.joints[v * 4 + 2];
-                verts[v].joints[3] = mesh.joints[v * 4 + 3];
-            } else {
-                verts[v].joints[0] = 0;
-                verts[v].joints[1] = 0;
-                verts[v].joints[2] = 0;
-                verts[v].joints[3] = 0;
+        }
+
+        // One pass from MeshData into the layout that gets uploaded.
+        std::vector<unsigned char> vertex_data;
+        if (layout == kVertexLayoutStatic) {
+            vertex_data.resize(sizeof(StaticVertex) * count);
+            StaticVertex* dst = reinterpret_cast<StaticVertex*>(vertex_data.data());
+            for (size_t v = 0; v < count; ++v, ++dst) {
+                MeshSurface surface;
+                ReadMeshSurface(mesh, v, &surface);
+                for (int c = 0; c < 3; ++c)
+                    dst->pos[c] = math::FloatToHalf(mesh.positions[v * 3 + c]);
+                dst->pos[3] = math::FloatToHalf(1.0f);
+                PackSurface(surface, dst->normal, dst->uv, dst->color);
             }
-            if (mesh.weights.size() >= (v + 1) * 4) {
-                verts[v].weights[0] = mesh.weights[v * 4 + 0];
-                verts[v].weights[1] = mesh.weights[v * 4 + 1];
-                verts[v].weights[2] = mesh.weights[v * 4 + 2];
-                verts[v].weights[3] = mesh.weights[v * 4 + 3];
-            } else {
-                verts[v].weights[0] = 1.0f;
-                verts[v].weights[1] = 0.0f;
-                verts[v].weights[2] = 0.0f;
-                verts[v].weights[3] = 0.0f;
+        } else if (layout == kVertexLayoutSkinned) {
+            vertex_data.resize(sizeof(SkinnedVertex) * count);
+            SkinnedVertex* dst = reinterpret_cast<SkinnedVertex*>(vertex_data.data());
+            for (size_t v = 0; v < count; ++v, ++dst) {
+                MeshSurface surface;
+                ReadMeshSurface(mesh, v, &surface);
+                std::memcpy(dst->pos, &mesh.positions[v * 3], sizeof(dst->pos));
+                PackSurface(surface, dst->normal, dst->uv, dst->color);
+                for (int c = 0; c < 4; ++c)
+                    dst->joints[c] = (uint8_t)surface.joints[c];
+                PackWeights(surface.weights, dst->weights);
+            }
+        } else {
+            vertex_data.resize(sizeof(Vertex) * count);
+            Vertex* dst = reinterpret_cast<Vertex*>(vertex_data.data());
+            for (size_t v = 0; v < count; ++v, ++dst) {
+                MeshSurface surface;
+                ReadMeshSurface(mesh, v, &surface);
+                std::memcpy(dst->pos, &mesh.positions[v * 3], sizeof(dst->pos));
+                std::memcpy(dst->color, surface.color, sizeof(dst->color));
+                std::memcpy(dst->normal, surface.normal, sizeof(dst->normal));
+                std::memcpy(dst->uv, surface.uv, sizeof(dst->uv));
+                std::memcpy(dst->joints, surface.joints, sizeof(dst->joints));
+                std::memcpy(dst->weights, surface.weights, sizeof(dst->weights));
             }
         }
 
         MeshBuffer buffer = {};
-        if (createVertexBuffer(verts.data(), verts.size(), &buffer.buffer, &buffer.memory)) {
-            buffer.vertex_count = (uint32_t)verts.size();
-            buffer.cpu_vertices = verts;
+        // Only skinned meshes on the no-depth fallback are rewritten per frame
+        // (triangle sort, on the index buffer); everything else is static and
+        // lives in VRAM.
+        const bool cpu_sorted = (mesh.is_skinned && !main_pass_has_depth_);
+        bool created = createStaticVertexBuffer(vertex_data.data(), vertex_data.size(), &buffer.buffer, &buffer.memory);
+        if (created &&
+            !createIndexBuffer(indices->data(), indices->size(), cpu_sorted, &buffer.index_buffer, &buffer.index_memory)) {
+            retireMeshBuffer(&buffer);
+            created = false;
+        }
+        if (created) {
+            buffer.vertex_count = (uint32_t)count;
+            buffer.layout = layout;
+            buffer.index_count = (uint32_t)indices->size();
+            if (cpu_sorted) {
+                buffer.cpu_positions.assign(mesh.positions.begin(), mesh.positions.begin() + count * 3);
+                buffer.cpu_indices = *indices;
+            }
             buffer.is_skinned = mesh.is_skinned;
-            if (buffer.is_skinned && !verts.empty()) {
-                float min_y = verts[0].pos[1];
-                for (size_t vi = 1; vi < verts.size(); ++vi)
-                    min_y = std::min(min_y, verts[vi].pos[1]);
-                // Move skinned mesh so its lowest point rests on block Y.
-                buffer.ground_offset_y = -min_y;
+            for (int axis = 0; axis < 3; ++axis) {
+                buffer.bounds_min[axis] = mesh.positions[axis];
+                buffer.bounds_max[axis] = mesh.positions[axis];
             }
+            for (size_t vi = 1; vi < count; ++vi) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    buffer.bounds_min[axis] = std::min(buffer.bounds_min[axis], mesh.positions[vi * 3 + axis]);
+                    buffer.bounds_max[axis] = std::max(buffer.bounds_max[axis], mesh.positions[vi * 3 + axis]);
+                }
+            }
+            // Move skinned mesh so its lowest point rests on block Y.
+            if (buffer.is_skinned)
+                buffer.ground_offset_y = -buffer.bounds_min[1];
             buffer.source_model_path = mesh.source_model_path;
             buffer.source_animation_path = mesh.source_animation_path;
-            buffer.animation_time = 0.0f;
             if (buffer.is_skinned && !kDisableSkinnedAnimationForDebug) {
-                GltfSkinningFrames frames;
-                std::string skin_error;
-                if (LoadGltfSkinningFrames(buffer.source_model_path,
-                                           buffer.source_animation_path,
-                                           &frames,
-                                           &skin_error)) {
-                    buffer.joint_count = frames.joint_count;
-                    buffer.frame_count = frames.frame_count;
-                    buffer.animation_duration = frames.duration;
-                    buffer.skin_palette = std::move(frames.palettes);
-                    std::fprintf(stderr,
-                                 "skinned renderer: mesh[%zu] skin frames loaded joints=%u frames=%u duration=%.3fs\n",
-                                 i,
-                                 buffer.joint_count,
-                                 buffer.frame_count,
-                                 buffer.animation_duration);
+                const std::string skeleton_key = buffer.source_model_path + "|" + buffer.source_animation_path;
+                std::map<std::string, std::shared_ptr<const GltfSkeleton> >::const_iterator cached = skeletons.find(skeleton_key);
+                if (cached != skeletons.end()) {
+                    buffer.skeleton = cached->second;
                 } else {
-                    if (!skin_error.empty()) {
+                    std::shared_ptr<GltfSkeleton> skeleton(new GltfSkeleton());
+                    std::string skin_error;
+                    if (LoadGltfSkeleton(buffer.source_model_path,
+                                         buffer.source_animation_path,
+                                         skeleton.get(),
+                                         &skin_error)) {
+                        buffer.skeleton = skeleton;
+                        std::fprintf(stderr,
+                                     "skinned renderer: mesh[%zu] skeleton loaded joints=%u clips=%zu duration=%.3fs\n",
+                                     i,
+                                     skeleton->jointCount(),
+                                     skeleton->clips.size(),
+                                     skeleton->clips[0].duration);
+                    } else if (!skin_error.empty()) {
                         std::fprintf(stderr,
                                      "skinned renderer: failed skinning load for mesh[%zu] model='%s' anim='%s': %s\n",
                                      i,
@@ -1399,15 +2575,10 @@ void VoxelRenderer::setBlockMeshes(const std::vector<MeshData>& meshes) {
                                      buffer.source_animation_path.c_str(),
                                      skin_error.c_str());
                     }
-                    buffer.joint_count = 0;
-                    buffer.frame_count = 0;
-                    buffer.skin_palette.clear();
+                    skeletons[skeleton_key] = buffer.skeleton;
                 }
+                buffer.joint_count = buffer.skeleton ? buffer.skeleton->jointCount() : 0;
             } else if (buffer.is_skinned) {
-                buffer.joint_count = 0;
-                buffer.frame_count = 0;
-                buffer.animation_duration = 0.0f;
-                buffer.skin_palette.clear();
                 std::fprintf(stderr,
                              "skinned renderer: animation disabled for debug (T-pose) mesh[%zu] model='%s'\n",
                              i,
@@ -1416,6 +2587,14 @@ void VoxelRenderer::setBlockMeshes(const std::vector<MeshData>& meshes) {
             block_meshes_[i] = buffer;
         }
     }
+
+    flushUploads();
+
+    // Blocks referencing these meshes now have different transforms and bounds.
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        block_models_[i] = blockModelMatrix(blocks_[i], blockMesh(blocks_[i]));
+        block_tree_.update(block_proxy_[i], blockBounds(i));
+    }
 }
 
 void VoxelRenderer::resizePickResources(uint32_t width, uint32_t height) {
@@ -1433,10 +2612,7 @@ void VoxelRenderer::resizePickResources(uint32_t width, uint32_t height) {
         vkDestroyImage(device_, pick_image_, nullptr);
         pick_image_ = VK_NULL_HANDLE;
     }
-    if (pick_image_memory_) {
-        vkFreeMemory(device_, pick_image_memory_, nullptr);
-        pick_image_memory_ = VK_NULL_HANDLE;
-    }
+    gpu_allocator_.free(&pick_image_memory_);
     if (pick_depth_view_) {
         vkDestroyImageView(device_, pick_depth_view_, nullptr);
         pick_depth_view_ = VK_NULL_HANDLE;
@@ -1445,10 +2621,7 @@ void VoxelRenderer::resizePickResources(uint32_t width, uint32_t height) {
         vkDestroyImage(device_, pick_depth_image_, nullptr);
         pick_depth_image_ = VK_NULL_HANDLE;
     }
-    if (pick_depth_memory_) {
-        vkFreeMemory(device_, pick_depth_memory_, nullptr);
-        pick_depth_memory_ = VK_NULL_HANDLE;
-    }
+    gpu_allocator_.free(&pick_depth_memory_);
 
     pick_extent_.width = width;
     pick_extent_.height = height;
@@ -1466,14 +2639,7 @@ void VoxelRenderer::resizePickResources(uint32_t width, uint32_t height) {
     image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
     vkCreateImage(device_, &image_info, nullptr, &pick_image_);
-    VkMemoryRequirements mem_reqs;
-    vkGetImageMemoryRequirements(device_, pick_image_, &mem_reqs);
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkAllocateMemory(device_, &alloc_info, nullptr, &pick_image_memory_);
-    vkBindImageMemory(device_, pick_image_, pick_image_memory_, 0);
+    allocateImageMemory(pick_image_, &pick_image_memory_);
 
     VkImageViewCreateInfo view_info = {};
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1489,11 +2655,7 @@ void VoxelRenderer::resizePickResources(uint32_t width, uint32_t height) {
     depth_info.format = VK_FORMAT_D32_SFLOAT;
     depth_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     vkCreateImage(device_, &depth_info, nullptr, &pick_depth_image_);
-    vkGetImageMemoryRequirements(device_, pick_depth_image_, &mem_reqs);
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkAllocateMemory(device_, &alloc_info, nullptr, &pick_depth_memory_);
-    vkBindImageMemory(device_, pick_depth_image_, pick_depth_memory_, 0);
+    allocateImageMemory(pick_depth_image_, &pick_depth_memory_);
 
     VkImageViewCreateInfo depth_view_info = {};
     depth_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1529,24 +2691,14 @@ bool VoxelRenderer::pickRect(uint32_t x, uint32_t y, uint32_t width, uint32_t he
     uint32_t rect_h = (height > max_h) ? max_h : height;
 
     VkBuffer staging_buffer = VK_NULL_HANDLE;
-    VkDeviceMemory staging_memory = VK_NULL_HANDLE;
+    VoxelGpuAllocation staging_memory;
     VkDeviceSize buffer_size = rect_w * rect_h * sizeof(uint32_t);
-    VkBufferCreateInfo buffer_info = {};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = buffer_size;
-    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    if (vkCreateBuffer(device_, &buffer_info, nullptr, &staging_buffer) != VK_SUCCESS)
-        return false;
-    VkMemoryRequirements mem_reqs;
-    vkGetBufferMemoryRequirements(device_, staging_buffer, &mem_reqs);
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    if (vkAllocateMemory(device_, &alloc_info, nullptr, &staging_memory) != VK_SUCCESS)
+    if (!createBuffer(buffer_size,
+                      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      &staging_buffer,
+                      &staging_memory))
         return false;
-    vkBindBufferMemory(device_, staging_buffer, staging_memory, 0);
 
     vkResetFences(device_, 1, &pick_fence_);
     vkResetCommandBuffer(pick_command_buffer_, 0);
@@ -1608,19 +2760,24 @@ bool VoxelRenderer::pickRect(uint32_t x, uint32_t y, uint32_t width, uint32_t he
                            camera_pos_[0] + fx, camera_pos_[1] + fy, camera_pos_[2] + fz,
                            0.0f, 1.0f, 0.0f);
 
-    for (size_t i = 0; i < blocks_.size(); ++i) {
-        Mat4 translate = mat4Translate(blocks_[i].x, blocks_[i].y, blocks_[i].z);
-        Mat4 rot_x = mat4RotateX(ToRadians(blocks_[i].rot_x_deg));
-        Mat4 rot_y = mat4RotateY(ToRadians(blocks_[i].rot_y_deg));
-        Mat4 rot_z = mat4RotateZ(ToRadians(blocks_[i].rot_z_deg));
-        Mat4 rotate = mat4Multiply(rot_y, mat4Multiply(rot_x, rot_z));
-        const float block_scale_mul = BlockScaleMultiplierPercent(blocks_[i].scale_percent);
-        Mat4 scale = mat4ScaleInternal(block_scale_ * block_scale_mul,
-                                       block_scale_ * block_scale_mul,
-                                       block_scale_ * block_scale_mul);
-        Mat4 model = mat4Multiply(translate, mat4Multiply(rotate, scale));
+    // Only blocks inside the sub-frustum of the pick rectangle can write ids.
+    const Mat4 view_proj = mat4Multiply(proj, view);
+    const float ndc_x0 = 2.0f * (float)x / (float)pick_extent_.width - 1.0f;
+    const float ndc_y0 = 2.0f * (float)y / (float)pick_extent_.height - 1.0f;
+    const float ndc_x1 = 2.0f * (float)(x + rect_w) / (float)pick_extent_.width - 1.0f;
+    const float ndc_y1 = 2.0f * (float)(y + rect_h) / (float)pick_extent_.height - 1.0f;
+    const VoxelFrustum frustum = VoxelFrustum::fromMatrixRect(view_proj.m, ndc_x0, ndc_y0, ndc_x1, ndc_y1);
+    std::vector<uint32_t> visible;
+    block_tree_.queryFrustum(frustum, &visible);
+
+    for (size_t v = 0; v < visible.size(); ++v) {
+        const size_t i = visible[v];
+        // The pick pass draws the plain cube; only skinned meshes use a
+        // different render transform than that cube.
+        const MeshBuffer* mesh = blockMesh(blocks_[i]);
+        const Mat4 model = (mesh && mesh->is_skinned) ? blockModelMatrix(blocks_[i], nullptr) : block_models_[i];
         PickPush pc = {};
-        pc.mvp = mat4Multiply(proj, mat4Multiply(view, model));
+        pc.mvp = mat4Multiply(view_proj, model);
         pc.id = (uint32_t)(i + 1);
         vkCmdPushConstants(pick_command_buffer_, pick_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PickPush), &pc);
         vkCmdDraw(pick_command_buffer_, cube_vertex_count_, 1, 0, 0);
@@ -1666,9 +2823,7 @@ bool VoxelRenderer::pickRect(uint32_t x, uint32_t y, uint32_t width, uint32_t he
     vkQueueSubmit(queue_, 1, &submit, pick_fence_);
     vkWaitForFences(device_, 1, &pick_fence_, VK_TRUE, UINT64_MAX);
 
-    void* mapped = nullptr;
-    vkMapMemory(device_, staging_memory, 0, buffer_size, 0, &mapped);
-    uint32_t* ids = static_cast<uint32_t*>(mapped);
+    const uint32_t* ids = reinterpret_cast<const uint32_t*>(staging_memory.mapped);
     out_flags->assign(blocks_.size(), 0);
     size_t pixel_count = (size_t)rect_w * (size_t)rect_h;
     for (size_t i = 0; i < pixel_count; ++i) {
@@ -1676,9 +2831,8 @@ bool VoxelRenderer::pickRect(uint32_t x, uint32_t y, uint32_t width, uint32_t he
         if (id > 0 && id - 1 < out_flags->size())
             (*out_flags)[id - 1] = 1;
     }
-    vkUnmapMemory(device_, staging_memory);
     vkDestroyBuffer(device_, staging_buffer, nullptr);
-    vkFreeMemory(device_, staging_memory, nullptr);
+    gpu_allocator_.free(&staging_memory);
     return true;
 }
 
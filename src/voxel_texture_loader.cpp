@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voxel_texture_loader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "../third_party/stb_image.h"
+
+namespace voxel {
+
+static const uint32_t kDdsMagic = 0x20534444u; // "DDS "
+static const size_t kDdsHeaderSize = 128;       // magic + DDS_HEADER
+static const size_t kDdsDx10HeaderSize = 20;
+
+static uint32_t FourCC(char a, char b, char c, char d) {
+    return (uint32_t)(unsigned char)a | ((uint32_t)(unsigned char)b << 8) |
+           ((uint32_t)(unsigned char)c << 16) | ((uint32_t)(unsigned char)d << 24);
+}
+
+static uint32_t ReadU32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool HasExtension(const std::string& path, const char* ext) {
+    const size_t len = std::strlen(ext);
+    if (path.size() < len)
+        return false;
+    for (size_t i = 0; i < len; ++i) {
+        char c = path[path.size() - len + i];
+        if (c >= 'A' && c <= 'Z')
+            c = (char)(c - 'A' + 'a');
+        if (c != ext[i])
+            return false;
+    }
+    return true;
+}
+
+uint32_t MipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    uint32_t size = std::max(width, height);
+    while (size > 1) {
+        size >>= 1;
+        levels += 1;
+    }
+    return levels;
+}
+
+// BC formats are 4x4 blocks of 8 (BC1) or 16 (BC3, BC7) bytes. DXGI sRGB
+// variants load as UNORM, matching the RGBA8 path.
+static bool LoadDds(const std::string& path, VoxelTextureData* out) {
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    const std::streamsize file_size = file.tellg();
+    if (file_size < (std::streamsize)kDdsHeaderSize)
+        return false;
+    std::vector<unsigned char> bytes((size_t)file_size);
+    file.seekg(0, std::ios::beg);
+    if (!file.read(reinterpret_cast<char*>(bytes.data()), file_size))
+        return false;
+    if (ReadU32(&bytes[0]) != kDdsMagic || ReadU32(&bytes[4]) != 124u)
+        return false;
+
+    const uint32_t height = ReadU32(&bytes[12]);
+    const uint32_t width = ReadU32(&bytes[16]);
+    const uint32_t file_levels = std::max(ReadU32(&bytes[28]), 1u);
+    const uint32_t fourcc = ReadU32(&bytes[84]);
+    size_t data_offset = kDdsHeaderSize;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    size_t block_bytes = 0;
+    if (fourcc == FourCC('D', 'X', 'T', '1')) {
+        format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        block_bytes = 8;
+    } else if (fourcc == FourCC('D', 'X', 'T', '5')) {
+        format = VK_FORMAT_BC3_UNORM_BLOCK;
+        block_bytes = 16;
+    } else if (fourcc == FourCC('D', 'X', '1', '0') && bytes.size() >= kDdsHeaderSize + kDdsDx10HeaderSize) {
+        const uint32_t dxgi_format = ReadU32(&bytes[kDdsHeaderSize]);
+        data_offset += kDdsDx10HeaderSize;
+        if (dxgi_format == 71u || dxgi_format == 72u) {
+            format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            block_bytes = 8;
+        } else if (dxgi_format == 77u || dxgi_format == 78u) {
+            format = VK_FORMAT_BC3_UNORM_BLOCK;
+            block_bytes = 16;
+        } else if (dxgi_format == 98u || dxgi_format == 99u) {
+            format = VK_FORMAT_BC7_UNORM_BLOCK;
+            block_bytes = 16;
+        }
+    }
+    if (format == VK_FORMAT_UNDEFINED || width == 0 || height == 0) {
+        std::fprintf(stderr, "texture: unsupported DDS format in %s\n", path.c_str());
+        return false;
+    }
+
+    const uint32_t levels = std::min(file_levels, MipLevelCount(width, height));
+    std::vector<size_t> offsets;
+    size_t total = 0;
+    for (uint32_t level = 0; level < levels; ++level) {
+        const size_t w = std::max(1u, width >> level);
+        const size_t h = std::max(1u, height >> level);
+        offsets.push_back(total);
+        total += ((w + 3) / 4) * ((h + 3) / 4) * block_bytes;
+    }
+    if (data_offset + total > bytes.size()) {
+        std::fprintf(stderr, "texture: truncated DDS file %s\n", path.c_str());
+        return false;
+    }
+
+    out->width = width;
+    out->height = height;
+    out->format = format;
+    out->level_offsets.swap(offsets);
+    out->pixels.assign(bytes.begin() + data_offset, bytes.begin() + data_offset + total);
+    return true;
+}
+
+bool LoadVoxelTexture(const std::string& path, VoxelTextureData* out) {
+    *out = VoxelTextureData();
+    if (path.empty())
+        return false;
+    if (HasExtension(path, ".dds"))
+        return LoadDds(path, out);
+
+    int tex_w = 0, tex_h = 0, tex_comp = 0;
+    unsigned char* pixels = stbi_load(path.c_str(), &tex_w, &tex_h, &tex_comp, 4);
+    if (!pixels)
+        return false;
+    out->width = (uint32_t)tex_w;
+    out->height = (uint32_t)tex_h;
+    out->format = VK_FORMAT_R8G8B8A8_UNORM;
+    out->level_offsets.assign(1, 0);
+    out->pixels.assign(pixels, pixels + (size_t)tex_w * (size_t)tex_h * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+void GenerateMipChainRgba8(VoxelTextureData* texture) {
+    if (texture->isCompressed() || texture->levelCount() != 1)
+        return;
+    const uint32_t levels = MipLevelCount(texture->width, texture->height);
+    size_t total = texture->pixels.size();
+    for (uint32_t level = 1; level < levels; ++level)
+        total += (size_t)std::max(1u, texture->width >> level) * std::max(1u, texture->height >> level) * 4;
+    texture->pixels.resize(total);
+
+    uint32_t src_w = texture->width;
+    uint32_t src_h = texture->height;
+    size_t src_offset = 0;
+    size_t dst_offset = (size_t)src_w * src_h * 4;
+    for (uint32_t level = 1; level < levels; ++level) {
+        const uint32_t dst_w = std::max(1u, src_w >> 1);
+        const uint32_t dst_h = std::max(1u, src_h >> 1);
+        const unsigned char* src = texture->pixels.data() + src_offset;
+        unsigned char* dst = texture->pixels.data() + dst_offset;
+        for (uint32_t y = 0; y < dst_h; ++y) {
+            const uint32_t y0 = std::min(2 * y, src_h - 1);
+            const uint32_t y1 = std::min(2 * y + 1, src_h - 1);
+            for (uint32_t x = 0; x < dst_w; ++x) {
+                const uint32_t x0 = std::min(2 * x, src_w - 1);
+                const uint32_t x1 = std::min(2 * x + 1, src_w - 1);
+                const unsigned char* p00 = src + ((size_t)y0 * src_w + x0) * 4;
+                const unsigned char* p01 = src + ((size_t)y0 * src_w + x1) * 4;
+                const unsigned char* p10 = src + ((size_t)y1 * src_w + x0) * 4;
+                const unsigned char* p11 = src + ((size_t)y1 * src_w + x1) * 4;
+                unsigned char* d = dst + ((size_t)y * dst_w + x) * 4;
+                for (int c = 0; c < 4; ++c)
+                    d[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+            }
+        }
+        texture->level_offsets.push_back(dst_offset);
+        src_offset = dst_offset;
+        dst_offset += (size_t)dst_w * dst_h * 4;
+        src_w = dst_w;
+        src_h = dst_h;
+    }
+}
+
+} // namespace voxel
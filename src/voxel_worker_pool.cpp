@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 CrowdWare
+ *
+ * This file is part of VoxelEngine.
+ *
+ *  VoxelEngine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  VoxelEngine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with VoxelEngine.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "voxel_worker_pool.h"
+
+#include <algorithm>
+
+namespace voxel {
+
+VoxelWorkerPool::VoxelWorkerPool()
+    : job_(nullptr),
+      job_count_(0),
+      next_job_(0),
+      busy_workers_(0),
+      run_serial_(0),
+      stopping_(false) {}
+
+VoxelWorkerPool::~VoxelWorkerPool() {
+    shutdown();
+}
+
+void VoxelWorkerPool::init(unsigned int thread_count) {
+    shutdown();
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    stopping_ = false;
+    threads_.reserve(thread_count - 1u);
+    for (unsigned int w = 1; w < thread_count; ++w)
+        threads_.push_back(std::thread(&VoxelWorkerPool::workerLoop, this, w, run_serial_));
+}
+
+void VoxelWorkerPool::shutdown() {
+    if (threads_.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (size_t t = 0; t < threads_.size(); ++t)
+        threads_[t].join();
+    threads_.clear();
+}
+
+void VoxelWorkerPool::run(size_t count, const Job& job) {
+    if (count == 0)
+        return;
+    if (threads_.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i)
+            job(i, 0u);
+        return;
+    }
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &job;
+        job_count_ = count;
+        next_job_.store(0);
+        busy_workers_ = static_cast<unsigned int>(threads_.size());
+        ++run_serial_;
+    }
+    wake_.notify_all();
+    drain(0u);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return busy_workers_ == 0; });
+    job_ = nullptr;
+}
+
+void VoxelWorkerPool::drain(unsigned int worker) {
+    for (size_t i = next_job_++; i < job_count_; i = next_job_++)
+        (*job_)(i, worker);
+}
+
+// seen_serial starts at the serial of the last finished run, so a new
+// worker only picks up runs started after it.
+void VoxelWorkerPool::workerLoop(unsigned int worker, uint64_t seen_serial) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, seen_serial]() { return stopping_ || run_serial_ != seen_serial; });
+            if (stopping_)
+                return;
+            seen_serial = run_serial_;
+        }
+        drain(worker);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_workers_ == 0)
+            done_.notify_one();
+    }
+}
+
+} // namespace voxel